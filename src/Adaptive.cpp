@@ -0,0 +1,221 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Adaptive.h"
+#include "Monitor.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace dimmer;
+
+constexpr UINT sampleIntervalMs = 1000;
+constexpr int sampleWidth = 64;
+constexpr int sampleHeight = 36;
+constexpr int sampleCount = sampleWidth * sampleHeight;
+
+/* content scale maps luminance 0..1 onto 0.5x..1.5x of the configured
+opacity. changes smaller than the hysteresis are ignored so small content
+changes (a blinking cursor, scrolling text) don't make the overlay pulse. */
+constexpr float minScale = 0.5f;
+constexpr float maxScale = 1.5f;
+constexpr float hysteresis = 0.1f;
+
+/* weight of the newest sample in the per-monitor exponential moving
+average. one frame of a bright splash screen shouldn't swing the overlay;
+content that stays bright for a few seconds should. */
+constexpr float smoothing = 0.35f;
+
+static AdaptiveDimming* instance = nullptr;
+
+float dimmer::measureLuminance(const uint32_t* pixels, int count) {
+    uint32_t histogram[256] = { 0 };
+    uint64_t total = 0;
+
+    for (int i = 0; i < count; i++) {
+        const uint32_t p = pixels[i];
+        /* bt.709 weights in 8.8 fixed point; pixels are 0x00RRGGBB */
+        const uint32_t y =
+            ((((p >> 16) & 0xff) * 54) +
+             (((p >> 8) & 0xff) * 183) +
+             ((p & 0xff) * 19)) >> 8;
+        histogram[y]++;
+        total += y;
+    }
+
+    /* 90th percentile */
+    const uint32_t target = (uint32_t) (count * 9 / 10);
+    uint32_t seen = 0;
+    int p90 = 255;
+    for (int i = 0; i < 256; i++) {
+        seen += histogram[i];
+        if (seen >= target) {
+            p90 = i;
+            break;
+        }
+    }
+
+    const float mean = (float) total / (float) count / 255.0f;
+    return (mean + (float) p90 / 255.0f) * 0.5f;
+}
+
+LuminanceSampler::LuminanceSampler()
+: memoryDc(nullptr)
+, bitmap(nullptr)
+, oldBitmap(nullptr)
+, pixels(nullptr) {
+}
+
+LuminanceSampler::~LuminanceSampler() {
+    if (this->memoryDc) {
+        SelectObject(this->memoryDc, this->oldBitmap);
+        DeleteObject(this->bitmap);
+        DeleteDC(this->memoryDc);
+    }
+}
+
+float LuminanceSampler::sample(HDC screen, const RECT& rect) {
+    if (!this->memoryDc) {
+        /* one tiny top-down 32bpp dib, reused for every sample */
+        BITMAPINFO bmi = {};
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = sampleWidth;
+        bmi.bmiHeader.biHeight = -sampleHeight;
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+
+        this->memoryDc = CreateCompatibleDC(nullptr);
+        this->bitmap = CreateDIBSection(
+            this->memoryDc, &bmi, DIB_RGB_COLORS, (void**) &this->pixels, nullptr, 0);
+
+        if (!this->bitmap) {
+            DeleteDC(this->memoryDc);
+            this->memoryDc = nullptr;
+            return -1.0f;
+        }
+
+        this->oldBitmap = SelectObject(this->memoryDc, this->bitmap);
+        SetStretchBltMode(this->memoryDc, COLORONCOLOR);
+    }
+
+    StretchBlt(
+        this->memoryDc, 0, 0, sampleWidth, sampleHeight,
+        screen, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top,
+        SRCCOPY);
+
+    GdiFlush();
+
+    return measureLuminance(this->pixels, sampleCount);
+}
+
+AdaptiveDimming::AdaptiveDimming(MonitorsChanged callback)
+: timerId(0)
+, monitorsChanged(callback) {
+    instance = this;
+}
+
+AdaptiveDimming::~AdaptiveDimming() {
+    if (this->timerId) {
+        KillTimer(nullptr, this->timerId);
+    }
+
+    instance = nullptr;
+}
+
+void AdaptiveDimming::update() {
+    bool enabled = isAdaptiveEnabled() && isDimmerEnabled();
+
+    if (enabled && !this->timerId) {
+        this->timerId = SetTimer(nullptr, 0, sampleIntervalMs, &AdaptiveDimming::timerProc);
+        this->sample();
+    }
+    else if (!enabled && this->timerId) {
+        KillTimer(nullptr, this->timerId);
+        this->timerId = 0;
+        this->reset();
+    }
+}
+
+void AdaptiveDimming::reset() {
+    this->smoothed.clear();
+    for (auto& monitor : queryMonitors()) {
+        setMonitorContentScale(monitor, 1.0f);
+    }
+}
+
+void AdaptiveDimming::sample() {
+    /* the screen dc doesn't include layered windows unless CAPTUREBLT is
+    specified, so our own overlays never feed back into the measurement. */
+    HDC screen = GetDC(nullptr);
+    bool changed = false;
+
+    for (auto& monitor : queryMonitors()) {
+        if (!isMonitorEnabled(monitor) || getMonitorOpacity(monitor) == 0.0f) {
+            continue;
+        }
+
+        float luminance = this->sampler.sample(screen, monitor.info.rcMonitor);
+        if (luminance < 0.0f) {
+            break;
+        }
+
+        auto it = this->smoothed.find(monitor.getId());
+        if (it == this->smoothed.end()) {
+            this->smoothed[monitor.getId()] = luminance;
+        }
+        else {
+            it->second += smoothing * (luminance - it->second);
+            luminance = it->second;
+        }
+
+        float scale = minScale + (maxScale - minScale) * luminance;
+
+        if (fabs(scale - getMonitorContentScale(monitor)) > hysteresis) {
+            setMonitorContentScale(monitor, scale);
+            changed = true;
+        }
+    }
+
+    ReleaseDC(nullptr, screen);
+
+    if (changed && this->monitorsChanged) {
+        this->monitorsChanged();
+    }
+}
+
+void CALLBACK AdaptiveDimming::timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    if (instance) {
+        instance->sample();
+    }
+}
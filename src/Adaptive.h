@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <functional>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdint>
+
+namespace dimmer {
+    /* returns a 0..1 luminance estimate for `count` 0x00RRGGBB pixels,
+    weighted towards the bright end: a mostly-dark screen with a large white
+    window should still count as bright. */
+    extern float measureLuminance(const uint32_t* pixels, int count);
+
+    /* downscales a rectangle of the screen into a reused 64x36 dib and
+    measures it. returns -1 if the dib couldn't be created. */
+    class LuminanceSampler {
+        public:
+            LuminanceSampler();
+            ~LuminanceSampler();
+
+            float sample(HDC screen, const RECT& rect);
+
+        private:
+            HDC memoryDc;
+            HBITMAP bitmap;
+            HGDIOBJ oldBitmap;
+            uint32_t* pixels;
+    };
+
+    /* content-adaptive dimming: once a second, takes a tiny downscaled
+    snapshot of each monitor and scales its overlay opacity up for bright
+    content and down for dark content. */
+    class AdaptiveDimming {
+        using MonitorsChanged = std::function<void()>;
+
+        public:
+            AdaptiveDimming(MonitorsChanged callback);
+            ~AdaptiveDimming();
+
+            /* starts or stops sampling to match isAdaptiveEnabled(). */
+            void update();
+
+        private:
+            static void CALLBACK timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+
+            void sample();
+            void reset();
+
+            UINT_PTR timerId;
+            LuminanceSampler sampler;
+            std::map<std::wstring, float> smoothed;
+            MonitorsChanged monitorsChanged;
+    };
+}
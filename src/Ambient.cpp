@@ -0,0 +1,316 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Ambient.h"
+#include "Monitor.h"
+#include "Util.h"
+#include <InitGuid.h>
+#include <SensorsApi.h>
+#include <Sensors.h>
+#include <algorithm>
+#include <cmath>
+
+#pragma comment(lib, "Sensorsapi.lib")
+
+using namespace dimmer;
+
+/* the curve's ends, in log10 lux, and the scales there */
+constexpr float darkLevel = 1.0f;
+constexpr float brightLevel = 3.0f;
+constexpr float darkScale = 1.5f;
+constexpr float brightScale = 0.5f;
+
+/* with a step every 250ms and each one covering 15% of the remaining
+distance, the average takes about 1.5s to follow a change. */
+constexpr UINT stepMs = 250;
+constexpr float smoothing = 0.15f;
+constexpr float threshold = 0.1f;
+constexpr float settledDistance = threshold / 4.0f;
+
+static AmbientLight* instance = nullptr;
+
+static float toLevel(float lux) {
+    return std::log10(std::max(1.0f, lux));
+}
+
+float dimmer::ambientScale(float lux) {
+    const float t = (toLevel(lux) - darkLevel) / (brightLevel - darkLevel);
+    return darkScale + (brightScale - darkScale) * std::min(1.0f, std::max(0.0f, t));
+}
+
+AmbientFilter::AmbientFilter() {
+    this->reset();
+}
+
+void AmbientFilter::reset() {
+    this->primed = false;
+    this->pending = false;
+    this->target = 0.0f;
+    this->smoothed = 0.0f;
+    this->applied = 0.0f;
+}
+
+void AmbientFilter::add(float lux) {
+    this->target = toLevel(lux);
+    this->pending = true;
+}
+
+bool AmbientFilter::step(float& scale, bool& settled) {
+    settled = true;
+    if (!this->pending) {
+        return false;
+    }
+
+    bool apply = false;
+    if (!this->primed) {
+        this->smoothed = this->target;
+        this->primed = true;
+        apply = true;
+    }
+    else {
+        this->smoothed += smoothing * (this->target - this->smoothed);
+        apply = std::fabs(this->smoothed - this->applied) >= threshold;
+    }
+
+    if (std::fabs(this->target - this->smoothed) < settledDistance) {
+        this->pending = false;
+    }
+    else {
+        settled = false;
+    }
+
+    if (apply) {
+        this->applied = this->smoothed;
+        scale = ambientScale(std::pow(10.0f, this->smoothed));
+    }
+    return apply;
+}
+
+/* receives the sensor's reports on the ui thread (we're in its
+single-threaded apartment) and hands them to the AmbientLight. */
+class dimmer::SensorEvents : public ISensorEvents {
+    public:
+        SensorEvents() : references(1) { }
+
+        STDMETHODIMP QueryInterface(REFIID iid, void** result) {
+            if (!result) {
+                return E_POINTER;
+            }
+            if (IsEqualIID(iid, IID_IUnknown) || IsEqualIID(iid, IID_ISensorEvents)) {
+                *result = static_cast<ISensorEvents*>(this);
+                this->AddRef();
+                return S_OK;
+            }
+            *result = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        STDMETHODIMP_(ULONG) AddRef() {
+            return ++this->references;
+        }
+
+        STDMETHODIMP_(ULONG) Release() {
+            ULONG count = --this->references;
+            if (count == 0) {
+                delete this;
+            }
+            return count;
+        }
+
+        STDMETHODIMP OnStateChanged(ISensor* sensor, SensorState state) {
+            return S_OK;
+        }
+
+        STDMETHODIMP OnDataUpdated(ISensor* sensor, ISensorDataReport* report) {
+            if (::instance && report) {
+                ::instance->reading(report);
+            }
+            return S_OK;
+        }
+
+        STDMETHODIMP OnEvent(ISensor* sensor, REFGUID id, IPortableDeviceValues* data) {
+            return S_OK;
+        }
+
+        STDMETHODIMP OnLeave(REFSENSOR_ID id) {
+            /* unplugged, or disabled in device manager. detaching lets go
+            of this sink, so it holds on to itself until it's done. */
+            this->AddRef();
+            if (::instance) {
+                ::instance->detach();
+            }
+            this->Release();
+            return S_OK;
+        }
+
+    private:
+        ULONG references;
+};
+
+AmbientLight::AmbientLight(MonitorsChanged callback)
+: com(false)
+, searched(false)
+, sensor(nullptr)
+, events(nullptr)
+, timerId(0)
+, monitorsChanged(callback) {
+    ::instance = this;
+
+    /* sensor events are delivered through the message loop of the
+    apartment that subscribed, which keeps them on the ui thread. */
+    this->com = SUCCEEDED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED));
+    this->update();
+}
+
+AmbientLight::~AmbientLight() {
+    this->detach();
+    if (this->com) {
+        CoUninitialize();
+    }
+    ::instance = nullptr;
+}
+
+void AmbientLight::update() {
+    bool enabled = this->com && isAmbientEnabled() && isDimmerEnabled();
+
+    if (enabled && !this->sensor && !this->searched) {
+        /* once per enable: a machine without a sensor doesn't grow one
+        between settings changes. */
+        this->searched = true;
+        this->attach();
+    }
+    else if (!enabled) {
+        this->detach();
+        this->searched = false;
+    }
+}
+
+bool AmbientLight::attach() {
+    Com<ISensorManager> manager;
+    if (FAILED(CoCreateInstance(CLSID_SensorManager, nullptr, CLSCTX_INPROC_SERVER,
+        IID_ISensorManager, reinterpret_cast<void**>(manager.out()))))
+    {
+        return false;
+    }
+
+    Com<ISensorCollection> sensors;
+    Com<ISensor> sensor;
+    if (FAILED(manager->GetSensorsByType(SENSOR_TYPE_AMBIENT_LIGHT, sensors.out())) ||
+        FAILED(sensors->GetAt(0, sensor.out())))
+    {
+        return false;
+    }
+
+    SensorEvents* events = new SensorEvents();
+    if (FAILED(sensor->SetEventSink(events))) {
+        events->Release();
+        return false;
+    }
+
+    this->events = events;
+    this->sensor = sensor.get();
+    this->sensor->AddRef();
+
+    /* the sensor only reports changes, so start from its current value */
+    Com<ISensorDataReport> report;
+    if (SUCCEEDED(this->sensor->GetData(report.out()))) {
+        this->reading(report.get());
+    }
+
+    return true;
+}
+
+void AmbientLight::detach() {
+    if (this->timerId) {
+        KillTimer(nullptr, this->timerId);
+        this->timerId = 0;
+    }
+
+    if (this->sensor) {
+        this->sensor->SetEventSink(nullptr);
+        this->sensor->Release();
+        this->sensor = nullptr;
+    }
+
+    if (this->events) {
+        this->events->Release();
+        this->events = nullptr;
+    }
+
+    this->filter.reset();
+
+    if (getAmbientScale() != 1.0f) {
+        setAmbientScale(1.0f);
+        if (this->monitorsChanged) {
+            this->monitorsChanged();
+        }
+    }
+}
+
+void AmbientLight::reading(ISensorDataReport* report) {
+    PROPVARIANT value;
+    PropVariantInit(&value);
+    if (SUCCEEDED(report->GetSensorValue(SENSOR_DATA_TYPE_LIGHT_LEVEL_LUX, &value)) &&
+        value.vt == VT_R4)
+    {
+        this->filter.add(value.fltVal);
+        this->step();
+    }
+    PropVariantClear(&value);
+}
+
+void AmbientLight::step() {
+    float scale;
+    bool settled;
+    if (this->filter.step(scale, settled)) {
+        setAmbientScale(scale);
+        if (this->monitorsChanged) {
+            this->monitorsChanged();
+        }
+    }
+
+    if (settled && this->timerId) {
+        KillTimer(nullptr, this->timerId);
+        this->timerId = 0;
+    }
+    else if (!settled && !this->timerId) {
+        this->timerId = SetTimer(nullptr, 0, stepMs, &AmbientLight::timerProc);
+    }
+}
+
+void CALLBACK AmbientLight::timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    if (::instance && id == ::instance->timerId) {
+        ::instance->step();
+    }
+}
@@ -0,0 +1,115 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <functional>
+
+struct ISensor;
+struct ISensorDataReport;
+
+namespace dimmer {
+    /* the opacity scale for a room at `lux`: linear in log10(lux), which
+    tracks perceived brightness far better than lux itself, from 1.5x the
+    configured opacity at 10 lux and below (a dim room) through 1x at 100 (a
+    living room) to 0.5x at 1000 and above (an office by a window). */
+    extern float ambientScale(float lux);
+
+    /* smooths sensor readings and decides when the room has changed enough
+    to act on. readings set a target that an exponential moving average (in
+    log10 lux) catches up with one step at a time, so a passing shadow
+    barely moves it. changes under about 25% (0.1 in log10 lux) aren't
+    noticeable and aren't applied. */
+    class AmbientFilter {
+        public:
+            AmbientFilter();
+
+            /* a new reading. only the latest one matters for the next step. */
+            void add(float lux);
+
+            /* advances the average one step. returns true, with the scale
+            to apply in `scale`, when it has moved far enough from the level
+            last applied; the first reading is applied at once. `settled` is
+            set once the average has caught up with the latest reading, and
+            no more steps are needed until the next one. */
+            bool step(float& scale, bool& settled);
+
+            void reset();
+
+        private:
+            bool primed;
+            bool pending;
+            float target;
+            float smoothed;
+            float applied;
+    };
+
+    class SensorEvents;
+
+    /* scales every monitor's opacity to the room's light, as measured by
+    the system's ambient light sensor, if it has one. readings arrive as
+    sensor events at the sensor's own report interval; the filter is only
+    stepped on a timer while it's catching up with a new reading, so a room
+    that stays the same costs no wakeups at all. */
+    class AmbientLight {
+        using MonitorsChanged = std::function<void()>;
+
+        public:
+            AmbientLight(MonitorsChanged callback);
+            ~AmbientLight();
+
+            /* attaches to or lets go of the sensor to match
+            isAmbientEnabled(). */
+            void update();
+
+        private:
+            friend class SensorEvents;
+
+            static void CALLBACK timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+
+            bool attach();
+            void detach();
+            void reading(ISensorDataReport* report);
+            void step();
+
+            bool com;
+            bool searched;
+            ISensor* sensor;
+            SensorEvents* events;
+            UINT_PTR timerId;
+            AmbientFilter filter;
+            MonitorsChanged monitorsChanged;
+    };
+}
@@ -0,0 +1,203 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Apps.h"
+#include <algorithm>
+#include <cwctype>
+
+using namespace dimmer;
+
+/* the window cache is thrown away when it reaches this size rather than
+being trimmed; most entries belong to windows that are long gone. */
+constexpr size_t maxCachedWindows = 512;
+
+static AppProfiles* instance = nullptr;
+
+static bool enabled() {
+    return isDimmerEnabled() && hasAppProfiles();
+}
+
+/* a window belongs to one process for its whole life, and that process
+can't exit (freeing its pid for reuse) while the window exists, so a live
+(pid, hwnd) pair always names the same executable. window handles only
+have 32 significant bits, even in 64 bit processes. */
+static uint64_t windowKey(DWORD pid, HWND hwnd) {
+    return ((uint64_t) pid << 32) | (uint32_t) (uintptr_t) hwnd;
+}
+
+static std::wstring getExecutableName(DWORD pid) {
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!process) {
+        return std::wstring();
+    }
+
+    wchar_t path[MAX_PATH] = { 0 };
+    DWORD length = MAX_PATH;
+    if (!QueryFullProcessImageName(process, 0, path, &length)) {
+        length = 0;
+    }
+
+    CloseHandle(process);
+
+    std::wstring exe(path, length);
+    exe = exe.substr(exe.find_last_of(L'\\') + 1);
+    std::transform(exe.begin(), exe.end(), exe.begin(), towlower);
+    return exe;
+}
+
+AppProfiles::AppProfiles(MonitorsChanged callback)
+: foregroundHook(nullptr)
+, moveSizeHook(nullptr)
+, activeMonitor(nullptr)
+, monitorsChanged(callback) {
+    ::instance = this;
+    this->update();
+}
+
+AppProfiles::~AppProfiles() {
+    this->unhook();
+    ::instance = nullptr;
+}
+
+void AppProfiles::update() {
+    if (enabled()) {
+        if (!this->foregroundHook) {
+            this->foregroundHook = SetWinEventHook(
+                EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND,
+                nullptr, &AppProfiles::eventProc, 0, 0,
+                WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+
+            /* the foreground window being dragged onto another monitor */
+            this->moveSizeHook = SetWinEventHook(
+                EVENT_SYSTEM_MOVESIZEEND, EVENT_SYSTEM_MOVESIZEEND,
+                nullptr, &AppProfiles::eventProc, 0, 0,
+                WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+        }
+
+        /* profiles may have been edited; callers refresh the overlays. */
+        this->apply(GetForegroundWindow());
+    }
+    else {
+        this->unhook();
+        this->clear();
+    }
+}
+
+void AppProfiles::unhook() {
+    if (this->foregroundHook) {
+        UnhookWinEvent(this->foregroundHook);
+        this->foregroundHook = nullptr;
+    }
+    if (this->moveSizeHook) {
+        UnhookWinEvent(this->moveSizeHook);
+        this->moveSizeHook = nullptr;
+    }
+}
+
+/* (pid, hwnd) -> executable name. a hit is one hash lookup with no system
+calls; only the first time a window is seen do we open its process. */
+AppProfilePtr AppProfiles::lookup(DWORD pid, HWND hwnd) {
+    const uint64_t key = windowKey(pid, hwnd);
+
+    auto it = this->windows.find(key);
+    if (it == this->windows.end()) {
+        if (this->windows.size() >= maxCachedWindows) {
+            this->windows.clear();
+        }
+        it = this->windows.insert({ key, getExecutableName(pid) }).first;
+    }
+
+    return findAppProfile(it->second);
+}
+
+/* returns true if any monitor's profile changed. */
+bool AppProfiles::apply(HWND foreground) {
+    DWORD pid = 0;
+    if (!foreground || !GetWindowThreadProcessId(foreground, &pid)) {
+        return false;
+    }
+
+    /* the tray menu taking the foreground shouldn't drop the profile */
+    if (pid == GetCurrentProcessId()) {
+        return false;
+    }
+
+    AppProfilePtr profile = this->lookup(pid, foreground);
+    HMONITOR monitor = profile
+        ? MonitorFromWindow(foreground, MONITOR_DEFAULTTONEAREST) : nullptr;
+
+    if (profile == this->activeProfile && monitor == this->activeMonitor) {
+        return false;
+    }
+
+    this->activeProfile = profile;
+    this->activeMonitor = monitor;
+
+    for (auto& m : queryMonitors()) {
+        setMonitorAppProfile(m, (m.handle == monitor) ? profile : AppProfilePtr());
+    }
+
+    return true;
+}
+
+void AppProfiles::clear() {
+    if (this->activeProfile) {
+        for (auto& m : queryMonitors()) {
+            setMonitorAppProfile(m, AppProfilePtr());
+        }
+    }
+
+    this->activeProfile.reset();
+    this->activeMonitor = nullptr;
+    this->windows.clear();
+}
+
+void CALLBACK AppProfiles::eventProc(
+    HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject,
+    LONG idChild, DWORD thread, DWORD time)
+{
+    if (!::instance || idObject != OBJID_WINDOW) {
+        return;
+    }
+
+    /* only moves of the foreground window can change which monitor gets
+    its profile */
+    if (event == EVENT_SYSTEM_MOVESIZEEND && hwnd != GetForegroundWindow()) {
+        return;
+    }
+
+    if (::instance->apply(hwnd)) {
+        ::instance->monitorsChanged();
+    }
+}
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include "Monitor.h"
+
+namespace dimmer {
+    /* applies the matching application profile (the "apps" section of
+    config.json) to the monitor showing the foreground window, and takes it
+    away again when that application loses the foreground. */
+    class AppProfiles {
+        using MonitorsChanged = std::function<void()>;
+
+        public:
+            AppProfiles(MonitorsChanged callback);
+            ~AppProfiles();
+
+            /* installs or removes the hook to match the current settings. */
+            void update();
+
+        private:
+            static void CALLBACK eventProc(
+                HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject,
+                LONG idChild, DWORD thread, DWORD time);
+
+            AppProfilePtr lookup(DWORD pid, HWND hwnd);
+            bool apply(HWND foreground);
+            void unhook();
+            void clear();
+
+            HWINEVENTHOOK foregroundHook;
+            HWINEVENTHOOK moveSizeHook;
+            AppProfilePtr activeProfile;
+            HMONITOR activeMonitor;
+            std::unordered_map<uint64_t, std::wstring> windows;
+            MonitorsChanged monitorsChanged;
+    };
+}
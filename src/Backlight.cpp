@@ -0,0 +1,630 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Backlight.h"
+#include "Metrics.h"
+#include "Util.h"
+#include <PhysicalMonitorEnumerationAPI.h>
+#include <LowLevelMonitorConfigurationAPI.h>
+#include <Wbemidl.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cwctype>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#pragma comment(lib, "Dxva2.lib")
+#pragma comment(lib, "wbemuuid.lib")
+
+#define WM_PANEL_FOUND (WM_USER + 4000)
+
+using namespace dimmer;
+
+/* vcp code for luminance, per the MCCS spec */
+constexpr BYTE VCP_BRIGHTNESS = 0x10;
+
+/* DDC/CI requires the host to wait at least 50ms after a write before
+sending the next command; some panels need a little more. */
+constexpr auto commandSpacing = std::chrono::milliseconds(60);
+
+class Worker {
+    public:
+        Worker(HMONITOR handle)
+        : handle(handle)
+        , target(-1)
+        , current(-1)
+        , failed(-1)
+        , quit(false) {
+            this->thread = std::thread(&Worker::proc, this);
+        }
+
+        ~Worker() {
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->quit = true;
+                this->condition.notify_one();
+            }
+            this->thread.join();
+        }
+
+        HMONITOR getHandle() const {
+            return this->handle;
+        }
+
+        void set(int percent) {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->target = percent;
+            this->failed = -1; /* a new request is worth another try */
+            this->condition.notify_one();
+        }
+
+        int get() {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            return this->current;
+        }
+
+    private:
+        void proc() {
+            std::vector<PHYSICAL_MONITOR> physical;
+            DWORD maximum = 100;
+            this->open(physical, maximum);
+
+            std::unique_lock<std::mutex> lock(this->mutex);
+            while (true) {
+                this->condition.wait(lock, [this] {
+                    return this->quit || (this->target >= 0 &&
+                        this->target != this->current && this->target != this->failed);
+                });
+
+                if (this->quit) {
+                    break;
+                }
+
+                const int percent = this->target;
+                lock.unlock();
+
+                bool written = false;
+                int actual = -1;
+                if (!physical.empty()) {
+                    metrics::Scope scope(metrics::SetBacklight);
+                    const DWORD value = (DWORD) percent * maximum / 100;
+                    written = true;
+                    for (auto& p : physical) {
+                        written = SetVCPFeature(p.hPhysicalMonitor, VCP_BRIGHTNESS, value) && written;
+                    }
+                    if (!written) {
+                        /* the panel may have taken the value anyway, or kept
+                        its old one; only the panel knows. */
+                        actual = read(physical[0].hPhysicalMonitor, maximum);
+                    }
+                }
+
+                lock.lock();
+                if (physical.empty()) {
+                    this->current = -1;
+                    this->target = -1; /* nothing to drive; don't spin */
+                }
+                else if (written) {
+                    this->current = percent;
+                }
+                else {
+                    /* don't retry until someone asks again */
+                    this->current = actual;
+                    this->failed = percent;
+                }
+
+                /* anything posted during the gap simply overwrites target */
+                this->condition.wait_for(lock, commandSpacing, [this] { return this->quit; });
+            }
+
+            lock.unlock();
+            DestroyPhysicalMonitors((DWORD) physical.size(), physical.data());
+        }
+
+        /* runs on the worker: even enumerating physical monitors can cost a
+        DDC round trip on some drivers. */
+        void open(std::vector<PHYSICAL_MONITOR>& physical, DWORD& maximum) {
+            DWORD count = 0;
+            if (!GetNumberOfPhysicalMonitorsFromHMONITOR(this->handle, &count) || count == 0) {
+                return;
+            }
+
+            physical.resize(count);
+            if (!GetPhysicalMonitorsFromHMONITOR(this->handle, count, physical.data())) {
+                physical.clear();
+                return;
+            }
+
+            /* after this the cached value is kept up to date by our own
+            writes; the panel is only read again if one of them fails. */
+            DWORD value = 0, max = 0;
+            MC_VCP_CODE_TYPE type;
+            if (GetVCPFeatureAndVCPFeatureReply(
+                physical[0].hPhysicalMonitor, VCP_BRIGHTNESS, &type, &value, &max) && max > 0)
+            {
+                maximum = max;
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->current = (int) (value * 100 / max);
+            }
+            else {
+                DestroyPhysicalMonitors(count, physical.data());
+                physical.clear();
+            }
+        }
+
+        /* the panel's current brightness as a percentage, or -1 */
+        static int read(HANDLE physical, DWORD maximum) {
+            DWORD value = 0, max = 0;
+            MC_VCP_CODE_TYPE type;
+            if (GetVCPFeatureAndVCPFeatureReply(physical, VCP_BRIGHTNESS, &type, &value, &max) && max > 0) {
+                return (int) (value * 100 / max);
+            }
+            return -1;
+        }
+
+        HMONITOR handle;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        int target;
+        int current;
+        int failed; /* the last target the panel refused */
+        bool quit;
+};
+
+class Bstr {
+    public:
+        Bstr(const wchar_t* value) : value(SysAllocString(value)) { }
+        ~Bstr() { SysFreeString(this->value); }
+        Bstr(const Bstr&) = delete;
+        Bstr& operator=(const Bstr&) = delete;
+        operator BSTR() const { return this->value; }
+
+    private:
+        BSTR value;
+};
+
+constexpr wchar_t panelClassName[] = L"DimmerPanelWatchClass";
+
+static ATOM panelClass = 0;
+static backlight::PanelWatch* panelWatch = nullptr;
+
+/* where panel workers report in; they run on their own threads. */
+static std::atomic<HWND> panelWindow(nullptr);
+
+/* WMI names a panel after its device instance, e.g.
+DISPLAY\BOE0812\4&2d5f2e0&0&UID8388688_0. the monitor's device interface
+name carries the same path: \\?\DISPLAY#BOE0812#4&2d5f2e0&0&UID8388688#{guid}.
+returns the shared part in upper case, or an empty string. */
+static std::wstring panelInstance(const Monitor& monitor) {
+    DISPLAY_DEVICE device = {};
+    device.cb = sizeof(device);
+    if (!EnumDisplayDevices(monitor.info.szDevice, 0, &device, EDD_GET_DEVICE_INTERFACE_NAME)) {
+        return std::wstring();
+    }
+
+    std::wstring id = device.DeviceID;
+    if (id.compare(0, 4, L"\\\\?\\") == 0) {
+        id = id.substr(4);
+    }
+    const size_t guid = id.rfind(L"#{");
+    if (guid != std::wstring::npos) {
+        id.resize(guid);
+    }
+    std::replace(id.begin(), id.end(), L'#', L'\\');
+    std::transform(id.begin(), id.end(), id.begin(), towupper);
+    return id;
+}
+
+/* the built-in panel of a laptop, driven through WmiMonitorBrightnessMethods.
+same shape as the DDC/CI worker: WMI calls are round trips to the firmware
+that take several milliseconds, so they run here, and only the newest
+target is kept. the worker's first job is finding the panel; displays
+without one just leave it idle. */
+class PanelWorker {
+    public:
+        PanelWorker(HMONITOR handle, const std::wstring& instance)
+        : handle(handle)
+        , instance(instance)
+        , target(-1)
+        , current(-1)
+        , original(-1)
+        , failed(-1)
+        , minimum(backlight::panelPending)
+        , quit(false) {
+            this->thread = std::thread(&PanelWorker::proc, this);
+        }
+
+        ~PanelWorker() {
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->quit = true;
+                this->condition.notify_one();
+            }
+            this->thread.join();
+        }
+
+        HMONITOR getHandle() const {
+            return this->handle;
+        }
+
+        void set(int percent) {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            if (percent != this->target) {
+                this->target = percent;
+                this->failed = -1;
+                this->condition.notify_one();
+            }
+        }
+
+        int getMinimum() {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            return this->minimum;
+        }
+
+    private:
+        /* the WMI objects, which live and die on the worker's thread */
+        struct Panel {
+            Com<IWbemServices> services;
+            Com<IWbemClassObject> parameters;
+            std::wstring brightnessPath;
+            std::wstring methodsPath;
+        };
+
+        /* -1 means "put back the level the panel had when we found it" */
+        int wanted() const {
+            return (this->target >= 0) ? this->target : this->original;
+        }
+
+        void proc() {
+            const bool com = SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+
+            {
+                Panel panel;
+                int found = com ? this->open(panel) : -1;
+
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->minimum = (found >= 0) ? found : -1;
+                if (HWND window = panelWindow.load()) {
+                    PostMessage(window, WM_PANEL_FOUND, 0, 0);
+                }
+
+                while (found >= 0) {
+                    this->condition.wait(lock, [this] {
+                        return this->quit || (this->wanted() >= 0 &&
+                            this->wanted() != this->current && this->wanted() != this->failed);
+                    });
+
+                    /* leave the panel the way we found it */
+                    const int percent = this->quit ? this->original : this->wanted();
+                    if (percent == this->current || percent < 0) {
+                        break;
+                    }
+
+                    lock.unlock();
+                    const bool written = write(panel, percent);
+                    const int actual = written ? percent : read(panel);
+                    lock.lock();
+
+                    this->current = actual;
+                    if (!written) {
+                        this->failed = percent; /* until someone asks again */
+                    }
+
+                    if (this->quit) {
+                        break;
+                    }
+                }
+            }
+
+            if (com) {
+                CoUninitialize();
+            }
+        }
+
+        /* connects to root\WMI and finds our panel. returns its lowest
+        supported level, or -1 if the monitor isn't a WMI backlit panel. */
+        int open(Panel& panel) {
+            if (this->instance.empty()) {
+                return -1;
+            }
+
+            Com<IWbemLocator> locator;
+            if (FAILED(CoCreateInstance(CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER,
+                IID_IWbemLocator, reinterpret_cast<void**>(locator.out()))))
+            {
+                return -1;
+            }
+
+            if (FAILED(locator->ConnectServer(Bstr(L"ROOT\\WMI"),
+                nullptr, nullptr, nullptr, 0, nullptr, nullptr, panel.services.out())))
+            {
+                return -1;
+            }
+
+            CoSetProxyBlanket(panel.services.get(), RPC_C_AUTHN_WINNT, RPC_C_AUTHZ_NONE, nullptr,
+                RPC_C_AUTHN_LEVEL_CALL, RPC_C_IMP_LEVEL_IMPERSONATE, nullptr, EOAC_NONE);
+
+            int lowest = -1;
+            Com<IWbemClassObject> brightness;
+            if (!this->find(panel, L"WmiMonitorBrightness", brightness, panel.brightnessPath)) {
+                return -1;
+            }
+
+            VARIANT value;
+            VariantInit(&value);
+            if (SUCCEEDED(brightness->Get(L"CurrentBrightness", 0, &value, nullptr, nullptr)) &&
+                value.vt == VT_UI1)
+            {
+                this->original = this->current = value.bVal;
+            }
+            VariantClear(&value);
+
+            if (SUCCEEDED(brightness->Get(L"Level", 0, &value, nullptr, nullptr)) &&
+                value.vt == (VT_ARRAY | VT_UI1))
+            {
+                BYTE* levels = nullptr;
+                LONG first = 0, last = -1;
+                SafeArrayGetLBound(value.parray, 1, &first);
+                SafeArrayGetUBound(value.parray, 1, &last);
+                if (SUCCEEDED(SafeArrayAccessData(value.parray, reinterpret_cast<void**>(&levels)))) {
+                    for (LONG i = 0; i <= last - first; i++) {
+                        lowest = (lowest < 0) ? levels[i] : std::min(lowest, (int) levels[i]);
+                    }
+                    SafeArrayUnaccessData(value.parray);
+                }
+            }
+            VariantClear(&value);
+
+            Com<IWbemClassObject> methods, type, signature;
+            if (this->original < 0 || lowest < 0 ||
+                !this->find(panel, L"WmiMonitorBrightnessMethods", methods, panel.methodsPath) ||
+                FAILED(panel.services->GetObject(Bstr(L"WmiMonitorBrightnessMethods"),
+                    0, nullptr, type.out(), nullptr)) ||
+                FAILED(type->GetMethod(L"WmiSetBrightness", 0, signature.out(), nullptr)) ||
+                FAILED(signature->SpawnInstance(0, panel.parameters.out())))
+            {
+                return -1;
+            }
+
+            return lowest;
+        }
+
+        /* the instance of `className` that belongs to our panel, and its path */
+        bool find(Panel& panel, const wchar_t* className, Com<IWbemClassObject>& result, std::wstring& path) {
+            Com<IEnumWbemClassObject> objects;
+            const std::wstring query = std::wstring(L"SELECT * FROM ") + className;
+            if (FAILED(panel.services->ExecQuery(Bstr(L"WQL"), Bstr(query.c_str()),
+                WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY, nullptr, objects.out())))
+            {
+                return false;
+            }
+
+            while (true) {
+                Com<IWbemClassObject> object;
+                ULONG count = 0;
+                if (objects->Next(WBEM_INFINITE, 1, object.out(), &count) != WBEM_S_NO_ERROR || count == 0) {
+                    return false;
+                }
+
+                VARIANT name;
+                VariantInit(&name);
+                bool match = false;
+                if (SUCCEEDED(object->Get(L"InstanceName", 0, &name, nullptr, nullptr)) && name.vt == VT_BSTR) {
+                    std::wstring upper = name.bstrVal;
+                    std::transform(upper.begin(), upper.end(), upper.begin(), towupper);
+                    match = (upper.compare(0, this->instance.size(), this->instance) == 0);
+                }
+                VariantClear(&name);
+
+                VARIANT location;
+                VariantInit(&location);
+                if (match && SUCCEEDED(object->Get(L"__PATH", 0, &location, nullptr, nullptr)) &&
+                    location.vt == VT_BSTR)
+                {
+                    path = location.bstrVal;
+                    VariantClear(&location);
+                    result.swap(object);
+                    return true;
+                }
+                VariantClear(&location);
+            }
+        }
+
+        static bool write(Panel& panel, int percent) {
+            metrics::Scope scope(metrics::SetBacklight);
+
+            VARIANT timeout, brightness;
+            VariantInit(&timeout);
+            VariantInit(&brightness);
+            timeout.vt = VT_I4; /* uint32 in the schema; WMI wants VT_I4 */
+            timeout.lVal = 0;
+            brightness.vt = VT_UI1;
+            brightness.bVal = (BYTE) percent;
+
+            return
+                SUCCEEDED(panel.parameters->Put(L"Timeout", 0, &timeout, 0)) &&
+                SUCCEEDED(panel.parameters->Put(L"Brightness", 0, &brightness, 0)) &&
+                SUCCEEDED(panel.services->ExecMethod(Bstr(panel.methodsPath.c_str()),
+                    Bstr(L"WmiSetBrightness"), 0, nullptr, panel.parameters.get(), nullptr, nullptr));
+        }
+
+        /* the panel's level right now, or -1 */
+        static int read(Panel& panel) {
+            Com<IWbemClassObject> object;
+            int result = -1;
+            if (SUCCEEDED(panel.services->GetObject(Bstr(panel.brightnessPath.c_str()),
+                0, nullptr, object.out(), nullptr)))
+            {
+                VARIANT value;
+                VariantInit(&value);
+                if (SUCCEEDED(object->Get(L"CurrentBrightness", 0, &value, nullptr, nullptr)) &&
+                    value.vt == VT_UI1)
+                {
+                    result = value.bVal;
+                }
+                VariantClear(&value);
+            }
+            return result;
+        }
+
+        HMONITOR handle;
+        std::wstring instance;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        int target;
+        int current;
+        int original;
+        int failed;
+        int minimum;
+        bool quit;
+};
+
+/* keyed by monitor id. only touched from the ui thread. */
+static std::map<std::wstring, std::unique_ptr<Worker>> workers;
+static std::map<std::wstring, std::unique_ptr<PanelWorker>> panels;
+
+static Worker& worker(Monitor& monitor) {
+    auto& result = workers[monitor.getId()];
+    if (!result || result->getHandle() != monitor.handle) {
+        /* topology changed. joining the old worker waits for at most one
+        in-flight write. */
+        result.reset();
+        result.reset(new Worker(monitor.handle));
+    }
+    return *result;
+}
+
+static PanelWorker& panelWorker(Monitor& monitor) {
+    auto& result = panels[monitor.getId()];
+    if (!result || result->getHandle() != monitor.handle) {
+        result.reset();
+        result.reset(new PanelWorker(monitor.handle, panelInstance(monitor)));
+    }
+    return *result;
+}
+
+/* drops the entries of `map` whose display is gone or changed handles */
+template <typename Map>
+static void pruneWorkers(Map& map, const std::vector<Monitor>& monitors) {
+    for (auto it = map.begin(); it != map.end();) {
+        auto m = std::find_if(monitors.begin(), monitors.end(), [&](const Monitor& monitor) {
+            return monitor.getId() == it->first;
+        });
+        if (m == monitors.end() || m->handle != it->second->getHandle()) {
+            it = map.erase(it); /* joins; the worker closes its handles */
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+namespace dimmer {
+    namespace backlight {
+        PanelWatch::PanelWatch(HINSTANCE instance, MonitorsChanged monitorsChanged)
+        : monitorsChanged(monitorsChanged) {
+            ::panelWatch = this;
+
+            if (!panelClass) {
+                WNDCLASS wc = {};
+                wc.lpfnWndProc = &PanelWatch::windowProc;
+                wc.hInstance = instance;
+                wc.lpszClassName = panelClassName;
+                panelClass = RegisterClass(&wc);
+            }
+
+            this->hwnd = CreateWindowEx(
+                0, panelClassName, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, instance, nullptr);
+            panelWindow = this->hwnd;
+        }
+
+        PanelWatch::~PanelWatch() {
+            panelWindow = nullptr;
+            DestroyWindow(this->hwnd);
+            ::panelWatch = nullptr;
+        }
+
+        LRESULT CALLBACK PanelWatch::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+            if (msg == WM_PANEL_FOUND) {
+                if (::panelWatch) {
+                    ::panelWatch->monitorsChanged();
+                }
+                return 0;
+            }
+            return DefWindowProc(hwnd, msg, wParam, lParam);
+        }
+
+        int findPanel(Monitor& monitor) {
+            return panelWorker(monitor).getMinimum();
+        }
+
+        void setPanel(Monitor& monitor, int percent) {
+            if (percent >= 0) {
+                panelWorker(monitor).set(std::min(100, percent));
+            }
+            else {
+                auto it = panels.find(monitor.getId());
+                if (it != panels.end()) {
+                    it->second->set(-1);
+                }
+            }
+        }
+
+        void set(Monitor& monitor, int percent) {
+            worker(monitor).set(std::min(100, std::max(0, percent)));
+        }
+
+        int get(Monitor& monitor) {
+            auto it = workers.find(monitor.getId());
+            return (it == workers.end()) ? -1 : it->second->get();
+        }
+
+        void prune(const std::vector<Monitor>& monitors) {
+            pruneWorkers(workers, monitors);
+            pruneWorkers(panels, monitors);
+        }
+
+        void shutdown() {
+            workers.clear();
+            panels.clear(); /* each puts its panel back first */
+        }
+    }
+}
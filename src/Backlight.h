@@ -0,0 +1,98 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Monitor.h"
+#include <functional>
+
+namespace dimmer {
+    namespace backlight {
+        /* hardware brightness over DDC/CI. a single VCP write takes 40-50ms
+        and blocks, so each display gets a worker thread; callers only ever
+        post the newest target, and targets posted while a write is in
+        flight (or during the enforced gap after it) replace each other. */
+
+        /* posts `percent` (0-100) as the target for `monitor`; never blocks. */
+        extern void set(Monitor& monitor, int percent);
+
+        /* the last value read from or successfully written to the panel,
+        or -1 if it's unknown or the display doesn't support DDC/CI. never
+        touches the bus; the panel is read when its worker starts and after
+        a write fails. a failed write isn't retried until set() is called
+        again. */
+        extern int get(Monitor& monitor);
+
+        /* the built-in panel of a laptop, driven through WMI rather than
+        DDC/CI, with a worker of its own per display. finding out whether a
+        display has such a panel is the worker's first job. */
+        constexpr int panelPending = -2;
+
+        /* the lowest level (0-100) the monitor's panel supports, -1 if it
+        has no WMI backlight, or panelPending while its worker, which the
+        first call starts, is still looking. never blocks. */
+        extern int findPanel(Monitor& monitor);
+
+        /* posts `percent` (0-100) as the panel's target, or -1 to put back
+        the level it had when its worker found it. -1 never starts a
+        worker. never blocks. */
+        extern void setPanel(Monitor& monitor, int percent);
+
+        /* calls `monitorsChanged` on the ui thread whenever a panel worker
+        has finished looking, so the overlays can hand the dimming over. */
+        class PanelWatch {
+            using MonitorsChanged = std::function<void()>;
+
+            public:
+                PanelWatch(HINSTANCE instance, MonitorsChanged monitorsChanged);
+                ~PanelWatch();
+
+            private:
+                static LRESULT CALLBACK windowProc(
+                    HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+                HWND hwnd;
+                MonitorsChanged monitorsChanged;
+        };
+
+        /* stops the workers (closing their physical monitor handles) of
+        displays that aren't in `monitors` anymore, or whose HMONITOR
+        changed. waits for at most one in-flight write each. */
+        extern void prune(const std::vector<Monitor>& monitors);
+
+        /* finishes any in-flight write and stops all workers; panels are
+        put back to the level they had. */
+        extern void shutdown();
+    }
+}
@@ -0,0 +1,796 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Control.h"
+#include "Monitor.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "Util.h"
+#include <sddl.h>
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <sstream>
+#include <vector>
+
+using namespace dimmer;
+
+#define WM_CONTROL_EXECUTE (WM_USER + 3000)
+
+constexpr wchar_t className[] = L"DimmerControlClass";
+constexpr DWORD bufferSize = 4096;
+constexpr DWORD maxClients = 4;
+constexpr DWORD idleTimeoutMs = 30000;
+constexpr DWORD writeTimeoutMs = 1000;
+
+/* a request marshalled from a pipe thread to the ui thread */
+struct Command {
+    const std::string* request;
+    std::string* response;
+    bool* subscribed;
+};
+
+static ATOM controlClass = 0;
+static std::map<HWND, Control*> hwndToInstance;
+
+/*
+ * commands, one per line (or separated by ';'):
+ *
+ *   list
+ *   metrics
+ *   metrics dump
+ *   trace
+ *   get <monitor> <field>
+ *   set <monitor|*> <field> <value>
+ *   get general <field>
+ *   set general <field> <value>
+ *   create profile <name>
+ *   subscribe
+ *   unsubscribe
+ *
+ * <monitor> is the 1-based index shown by `list`, or the monitor's name
+ * (e.g. DISPLAY1). per-monitor fields are opacity, temperature (kelvin,
+ * 1000-10000, -1 for none), enabled, backlight (0-100, -1 leaves the panel
+ * alone), gamma, contrast and blackLift. general fields are enabled,
+ * polling, adaptive, ambient, focusFollow, panel, idleTimeout (seconds up to
+ * 86400, 0 disables), idleOpacity, unfocusedOpacity, fullscreen
+ * (overlay|gamma|suspend) and profile (which must already exist;
+ * `create profile` adds one as a copy of the active profile without
+ * switching to it). `metrics dump` writes the `metrics` snapshot to
+ * metrics.json in the data directory. each command produces one line in
+ * the reply: the value for `get`, `ok` for everything else that succeeds,
+ * or `error <reason>`. a batch containing any successful `set` or `create`
+ * triggers a single overlay update.
+ *
+ * after `subscribe`, the connection also receives a `changed` message
+ * whenever the overlays are updated, for whatever reason; changes that
+ * happen before the client gets around to reading coalesce into one. up to
+ * four clients can be connected at a time. one that sends nothing for 30
+ * seconds (unless subscribed), or doesn't read a reply or notification
+ * within a second, is disconnected.
+ */
+
+/* pipe names are global across sessions, so on a terminal server each
+session's instance needs its own: \\.\pipe\dimmer-<session id> */
+static std::wstring getPipeName() {
+    DWORD sessionId = 0;
+    ProcessIdToSessionId(GetCurrentProcessId(), &sessionId);
+    return L"\\\\.\\pipe\\dimmer-" + std::to_wstring(sessionId);
+}
+
+static void registerClass(HINSTANCE instance, WNDPROC wndProc) {
+    if (!controlClass) {
+        WNDCLASS wc = {};
+        wc.lpfnWndProc = wndProc;
+        wc.hInstance = instance;
+        wc.lpszClassName = className;
+        controlClass = RegisterClass(&wc);
+    }
+}
+
+static std::vector<std::string> split(const std::string& commands) {
+    std::vector<std::string> result;
+    std::string current;
+    for (char c : commands) {
+        if (c == '\n' || c == ';') {
+            result.push_back(current);
+            current.clear();
+        }
+        else if (c != '\r') {
+            current += c;
+        }
+    }
+    result.push_back(current);
+    return result;
+}
+
+static bool parseBool(const std::string& value, bool& result) {
+    if (value == "1" || value == "true" || value == "on") {
+        result = true;
+        return true;
+    }
+    if (value == "0" || value == "false" || value == "off") {
+        result = false;
+        return true;
+    }
+    return false;
+}
+
+static bool findMonitors(
+    const std::string& selector,
+    std::vector<Monitor>& all,
+    std::vector<Monitor*>& result)
+{
+    if (selector == "*") {
+        for (auto& m : all) {
+            result.push_back(&m);
+        }
+        return true;
+    }
+
+    char* end = nullptr;
+    long index = strtol(selector.c_str(), &end, 10);
+    if (end && *end == '\0' && index >= 1 && (size_t) index <= all.size()) {
+        result.push_back(&all[index - 1]);
+        return true;
+    }
+
+    for (auto& m : all) {
+        if (u16to8(m.getName()) == selector) {
+            result.push_back(&m);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+struct GeneralFlag {
+    const char* name;
+    bool (*get)();
+    void (*set)(bool);
+};
+
+static const GeneralFlag generalFlags[] = {
+    { "enabled", &isDimmerEnabled, &setDimmerEnabled },
+    { "polling", &isPollingEnabled, &setPollingEnabled },
+    { "adaptive", &isAdaptiveEnabled, &setAdaptiveEnabled },
+    { "ambient", &isAmbientEnabled, &setAmbientEnabled },
+    { "focusFollow", &isFocusFollowEnabled, &setFocusFollowEnabled },
+    { "panel", &isPanelDimmingEnabled, &setPanelDimmingEnabled }
+};
+
+/* 0..1 opacity levels; values outside the range are clamped */
+struct GeneralLevel {
+    const char* name;
+    float (*get)();
+    void (*set)(float);
+};
+
+static const GeneralLevel generalLevels[] = {
+    { "idleOpacity", &getIdleOpacity, &setIdleOpacity },
+    { "unfocusedOpacity", &getUnfocusedOpacity, &setUnfocusedOpacity }
+};
+
+/* tone curve parameters that can be set per monitor. the control points
+themselves are only configurable through config.json. */
+static float ToneCurve::* curveField(const std::string& field) {
+    if (field == "gamma") {
+        return &ToneCurve::gamma;
+    }
+    if (field == "contrast") {
+        return &ToneCurve::contrast;
+    }
+    if (field == "blackLift") {
+        return &ToneCurve::blackLift;
+    }
+    return nullptr;
+}
+
+static std::string executeGeneral(
+    const std::string& verb,
+    const std::string& field,
+    const std::string& value,
+    bool& changed)
+{
+    char* end = nullptr;
+
+    for (auto& flag : generalFlags) {
+        if (field == flag.name) {
+            bool b = false;
+            if (verb == "get") {
+                return flag.get() ? "1" : "0";
+            }
+            if (!parseBool(value, b)) {
+                return "error invalid value";
+            }
+            if (flag.get() != b) {
+                flag.set(b);
+                changed = true;
+            }
+            return "ok";
+        }
+    }
+
+    if (field == "idleTimeout") {
+        if (verb == "get") {
+            return std::to_string(getIdleTimeout());
+        }
+        long seconds = strtol(value.c_str(), &end, 10);
+        if (*end != '\0' || seconds < 0 || seconds > maxIdleTimeout) {
+            return "error invalid value";
+        }
+        if (getIdleTimeout() != (int) seconds) {
+            setIdleTimeout((int) seconds);
+            changed = true;
+        }
+        return "ok";
+    }
+
+    for (auto& level : generalLevels) {
+        if (field == level.name) {
+            if (verb == "get") {
+                return std::to_string(level.get());
+            }
+            float opacity = strtof(value.c_str(), &end);
+            if (*end != '\0') {
+                return "error invalid value";
+            }
+            opacity = std::min(1.0f, std::max(0.0f, opacity));
+            if (level.get() != opacity) {
+                level.set(opacity);
+                changed = true;
+            }
+            return "ok";
+        }
+    }
+
+    if (field == "profile") {
+        if (verb == "get") {
+            return getActiveProfile();
+        }
+        if (value.empty()) {
+            return "error invalid value";
+        }
+        if (getActiveProfile() != value) {
+            if (!setActiveProfile(value)) {
+                return "error unknown profile";
+            }
+            changed = true;
+        }
+        return "ok";
+    }
+
+    if (field == "fullscreen") {
+        FullscreenPolicy policy;
+        if (verb == "get") {
+            return getFullscreenPolicyName(getFullscreenPolicy());
+        }
+        if (!parseFullscreenPolicyName(value, policy)) {
+            return "error invalid value";
+        }
+        if (getFullscreenPolicy() != policy) {
+            setFullscreenPolicy(policy);
+            changed = true;
+        }
+        return "ok";
+    }
+
+    return "error unknown field";
+}
+
+/* only the user running dimmer may open the pipe. the default descriptor
+lets any local account connect, and with a single instance one idle client
+was enough to lock everyone else out. returns nullptr on failure; release
+with LocalFree(). */
+static PSECURITY_DESCRIPTOR createPipeSecurity() {
+    HANDLE token = nullptr;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+        return nullptr;
+    }
+
+    PSECURITY_DESCRIPTOR descriptor = nullptr;
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+    std::vector<BYTE> user(size);
+
+    LPWSTR sid = nullptr;
+    if (size &&
+        GetTokenInformation(token, TokenUser, user.data(), size, &size) &&
+        ConvertSidToStringSid(reinterpret_cast<TOKEN_USER*>(user.data())->User.Sid, &sid))
+    {
+        /* protected, so nothing is inherited: full access for this user,
+        nobody else. */
+        std::wstring sddl = L"D:P(A;;GA;;;" + std::wstring(sid) + L")";
+        ConvertStringSecurityDescriptorToSecurityDescriptor(
+            sddl.c_str(), SDDL_REVISION_1, &descriptor, nullptr);
+        LocalFree(sid);
+    }
+
+    CloseHandle(token);
+    return descriptor;
+}
+
+Control::Control(HINSTANCE instance, MonitorsChanged callback, const std::wstring& pipeName)
+: hwnd(nullptr)
+, stopEvent(CreateEvent(nullptr, TRUE, FALSE, nullptr))
+, quit(false)
+, monitorsChanged(callback) {
+    registerClass(instance, &windowProc);
+
+    /* a message-only window; the pipe threads use it to marshal commands
+    onto the ui thread, which owns all monitor state. */
+    this->hwnd = CreateWindowEx(
+        0, className, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, instance, this);
+
+    hwndToInstance[this->hwnd] = this;
+
+    /* without a descriptor we'd fall back to the default one; better to not
+    listen at all. */
+    PSECURITY_DESCRIPTOR descriptor = createPipeSecurity();
+    if (!descriptor || !this->stopEvent) {
+        if (descriptor) {
+            LocalFree(descriptor);
+        }
+        return;
+    }
+
+    SECURITY_ATTRIBUTES security = { sizeof(SECURITY_ATTRIBUTES), descriptor, FALSE };
+    const std::wstring name = pipeName.empty() ? getPipeName() : pipeName;
+
+    /* one instance, and one thread, per concurrent client. the first
+    instance fails if another process already owns the name. */
+    for (DWORD i = 0; i < maxClients; i++) {
+        HANDLE pipe = CreateNamedPipe(
+            name.c_str(),
+            PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (i == 0 ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            maxClients,
+            bufferSize,
+            bufferSize,
+            0,
+            &security);
+
+        if (pipe == INVALID_HANDLE_VALUE) {
+            break;
+        }
+
+        std::unique_ptr<Client> client(new Client());
+        client->pipe = pipe;
+        client->changed = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        this->clients.push_back(std::move(client));
+    }
+
+    LocalFree(descriptor);
+
+    for (auto& client : this->clients) {
+        client->thread = std::thread(&Control::clientProc, this, std::ref(*client));
+    }
+}
+
+Control::~Control() {
+    this->quit = true;
+
+    /* every pipe operation is overlapped and also waits on the stop event,
+    so signalling it unblocks the threads wherever they are, except in
+    SendMessage(), where they are waiting on us. keep dispatching sent
+    messages until they exit. */
+    SetEvent(this->stopEvent);
+
+    for (auto& client : this->clients) {
+        if (client->thread.joinable()) {
+            HANDLE handle = (HANDLE) client->thread.native_handle();
+            while (MsgWaitForMultipleObjects(1, &handle, FALSE, INFINITE, QS_SENDMESSAGE) != WAIT_OBJECT_0) {
+                MSG msg;
+                PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+            }
+
+            client->thread.join();
+        }
+
+        CloseHandle(client->pipe);
+
+        if (client->changed) {
+            CloseHandle(client->changed);
+        }
+    }
+
+    if (this->stopEvent) {
+        CloseHandle(this->stopEvent);
+    }
+
+    DestroyWindow(this->hwnd);
+
+    auto it = hwndToInstance.find(this->hwnd);
+    if (it != hwndToInstance.end()) {
+        hwndToInstance.erase(it);
+    }
+}
+
+void Control::notifySubscribers() {
+    for (auto& it : hwndToInstance) {
+        for (auto& client : it.second->clients) {
+            if (client->changed) {
+                SetEvent(client->changed);
+            }
+        }
+    }
+}
+
+/* finishes an overlapped operation started on `pipe`. returns false if the
+operation failed, or if the stop event was signalled or `timeout` expired
+first, in which case the operation is cancelled. ERROR_MORE_DATA is left in
+GetLastError() for message reads that did not fit the buffer. */
+bool Control::complete(HANDLE pipe, BOOL started, OVERLAPPED& io, DWORD& bytes, DWORD timeout) {
+    bytes = 0;
+
+    if (!started && GetLastError() == ERROR_IO_PENDING) {
+        HANDLE handles[] = { io.hEvent, this->stopEvent };
+        if (WaitForMultipleObjects(2, handles, FALSE, timeout) != WAIT_OBJECT_0) {
+            CancelIoEx(pipe, &io);
+            GetOverlappedResult(pipe, &io, &bytes, TRUE);
+            return false;
+        }
+    }
+    else if (!started && GetLastError() != ERROR_MORE_DATA) {
+        return false;
+    }
+
+    return GetOverlappedResult(pipe, &io, &bytes, FALSE) != FALSE;
+}
+
+void Control::clientProc(Client& client) {
+    char buffer[bufferSize];
+    std::string request, response;
+    const std::string changed = "changed\n";
+
+    OVERLAPPED io = { 0 };
+    io.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+    OVERLAPPED push = { 0 };
+    push.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+    while (!this->quit && io.hEvent && push.hEvent && client.changed) {
+        DWORD bytes = 0;
+        BOOL started = ConnectNamedPipe(client.pipe, &io);
+        bool connected = (!started && GetLastError() == ERROR_PIPE_CONNECTED) ||
+            this->complete(client.pipe, started, io, bytes, INFINITE);
+
+        if (!connected) {
+            if (WaitForSingleObject(this->stopEvent, 0) == WAIT_OBJECT_0) {
+                break;
+            }
+
+            DisconnectNamedPipe(client.pipe); /* client came and went */
+            continue;
+        }
+
+        /* changes from before this client connected aren't its business */
+        ResetEvent(client.changed);
+        bool subscribed = false;
+        bool open = true;
+
+        while (open && !this->quit) {
+            started = ReadFile(client.pipe, buffer, bufferSize, nullptr, &io);
+
+            /* while a read is pending, a subscriber is sent a "changed"
+            message for every batch of changes (several changes between two
+            wakeups coalesce into one). anyone else has idleTimeoutMs to say
+            something before they're dropped to free the instance. */
+            if (!started && GetLastError() == ERROR_IO_PENDING) {
+                HANDLE handles[] = { io.hEvent, this->stopEvent, client.changed };
+                while (true) {
+                    DWORD wait = WaitForMultipleObjects(
+                        3, handles, FALSE, subscribed ? INFINITE : idleTimeoutMs);
+
+                    if (wait == WAIT_OBJECT_0 + 2) {
+                        if (subscribed) {
+                            BOOL pushed = WriteFile(
+                                client.pipe, changed.c_str(), (DWORD) changed.size(), nullptr, &push);
+                            if (!this->complete(client.pipe, pushed, push, bytes, writeTimeoutMs)) {
+                                open = false;
+                            }
+                        }
+                        if (open) {
+                            continue;
+                        }
+                    }
+
+                    if (wait != WAIT_OBJECT_0) {
+                        CancelIoEx(client.pipe, &io);
+                        GetOverlappedResult(client.pipe, &io, &bytes, TRUE);
+                        open = false;
+                    }
+
+                    break;
+                }
+
+                if (!open) {
+                    break;
+                }
+
+                started = TRUE; /* the read finished; collect it below */
+            }
+
+            bool done = this->complete(client.pipe, started, io, bytes, INFINITE);
+
+            if (!done && GetLastError() != ERROR_MORE_DATA) {
+                break; /* client went away, or we're stopping */
+            }
+
+            request.append(buffer, bytes);
+
+            if (done) {
+                response.clear();
+
+                Command command = { &request, &response, &subscribed };
+                SendMessage(this->hwnd, WM_CONTROL_EXECUTE, 0, reinterpret_cast<LPARAM>(&command));
+
+                /* a client that doesn't read its replies doesn't get to
+                hold the instance either. */
+                started = WriteFile(client.pipe, response.c_str(), (DWORD) response.size(), nullptr, &io);
+                open = this->complete(client.pipe, started, io, bytes, writeTimeoutMs);
+                request.clear();
+            }
+        }
+
+        request.clear();
+        DisconnectNamedPipe(client.pipe);
+    }
+
+    if (io.hEvent) {
+        CloseHandle(io.hEvent);
+    }
+
+    if (push.hEvent) {
+        CloseHandle(push.hEvent);
+    }
+}
+
+std::string dimmer::executeCommands(const std::string& commands, bool& changed, bool* subscribed) {
+    std::string result;
+    ConfigBatch batch;
+
+    for (auto& command : split(commands)) {
+        std::istringstream in(command);
+        std::string verb, target, field, value;
+        in >> verb >> target >> field >> value;
+
+        if (verb.empty()) {
+            continue;
+        }
+
+        std::string reply = "ok";
+
+        if (verb == "list") {
+            reply.clear();
+            auto monitors = queryMonitors();
+            for (size_t i = 0; i < monitors.size(); i++) {
+                if (i > 0) {
+                    reply += " ";
+                }
+                reply += std::to_string(i + 1) + "=" + u16to8(monitors[i].getName());
+            }
+        }
+        else if (verb == "metrics") {
+            if (target == "dump") {
+                if (!metrics::dump(getDataDirectory() + L"\\metrics.json")) {
+                    reply = "error couldn't write metrics.json";
+                }
+            }
+            else if (!target.empty()) {
+                reply = "error unknown command";
+            }
+            else {
+                reply = metrics::snapshot();
+            }
+        }
+        else if (verb == "trace") {
+            if (!trace::flush()) {
+                reply = "error tracing disabled";
+            }
+        }
+        else if (subscribed && (verb == "subscribe" || verb == "unsubscribe")) {
+            *subscribed = (verb == "subscribe");
+        }
+        else if (verb == "create") {
+            if (target != "profile" || field.empty()) {
+                reply = "error unknown command";
+            }
+            else if (!createProfile(field)) {
+                reply = "error profile exists";
+            }
+            else {
+                changed = true;
+            }
+        }
+        else if (verb != "get" && verb != "set") {
+            reply = "error unknown command";
+        }
+        else if (verb == "set" && value.empty()) {
+            reply = "error missing value";
+        }
+        else if (target == "general") {
+            reply = executeGeneral(verb, field, value, changed);
+        }
+        else {
+            auto all = queryMonitors();
+            std::vector<Monitor*> monitors;
+
+            if (!findMonitors(target, all, monitors) ||
+                (verb == "get" && monitors.size() != 1))
+            {
+                reply = "error unknown monitor";
+            }
+            else if (verb == "get") {
+                Monitor& m = *monitors.front();
+                if (field == "opacity") {
+                    reply = std::to_string(getMonitorOpacity(m));
+                }
+                else if (field == "temperature") {
+                    reply = std::to_string(getMonitorTemperature(m));
+                }
+                else if (field == "enabled") {
+                    reply = isMonitorEnabled(m) ? "1" : "0";
+                }
+                else if (field == "backlight") {
+                    reply = std::to_string(getMonitorBacklight(m));
+                }
+                else if (auto member = curveField(field)) {
+                    ToneCurvePtr curve = getMonitorToneCurve(m);
+                    reply = std::to_string(curve ? (*curve).*member : ToneCurve().*member);
+                }
+                else {
+                    reply = "error unknown field";
+                }
+            }
+            else {
+                char* end = nullptr;
+                bool b = false;
+                if (field == "opacity") {
+                    float opacity = strtof(value.c_str(), &end);
+                    if (*end == '\0') {
+                        opacity = std::min(1.0f, std::max(0.0f, opacity));
+                        for (auto m : monitors) {
+                            if (getMonitorOpacity(*m) != opacity) {
+                                setMonitorOpacity(*m, opacity);
+                                changed = true;
+                            }
+                        }
+                    }
+                    else {
+                        reply = "error invalid value";
+                    }
+                }
+                else if (field == "temperature") {
+                    long temperature = strtol(value.c_str(), &end, 10);
+                    if (*end == '\0' && temperature >= INT_MIN && temperature <= INT_MAX &&
+                        isValidTemperature((int) temperature))
+                    {
+                        for (auto m : monitors) {
+                            if (getMonitorTemperature(*m) != (int) temperature) {
+                                setMonitorTemperature(*m, (int) temperature);
+                                changed = true;
+                            }
+                        }
+                    }
+                    else {
+                        reply = "error invalid value";
+                    }
+                }
+                else if (field == "enabled") {
+                    if (parseBool(value, b)) {
+                        for (auto m : monitors) {
+                            if (isMonitorEnabled(*m) != b) {
+                                setMonitorEnabled(*m, b);
+                                changed = true;
+                            }
+                        }
+                    }
+                    else {
+                        reply = "error invalid value";
+                    }
+                }
+                else if (field == "backlight") {
+                    long percent = strtol(value.c_str(), &end, 10);
+                    if (*end == '\0' && percent >= -1 && percent <= 100) {
+                        for (auto m : monitors) {
+                            if (getMonitorBacklight(*m) != (int) percent) {
+                                setMonitorBacklight(*m, (int) percent);
+                                changed = true;
+                            }
+                        }
+                    }
+                    else {
+                        reply = "error invalid value";
+                    }
+                }
+                else if (auto member = curveField(field)) {
+                    float f = strtof(value.c_str(), &end);
+                    ToneCurve probe;
+                    probe.*member = f;
+                    if (*end == '\0' && probe.isValid()) {
+                        for (auto m : monitors) {
+                            ToneCurvePtr current = getMonitorToneCurve(*m);
+                            if ((current ? *current : ToneCurve()).*member == f) {
+                                continue;
+                            }
+                            auto curve = current
+                                ? std::make_shared<ToneCurve>(*current)
+                                : std::make_shared<ToneCurve>();
+                            (*curve).*member = f;
+                            setMonitorToneCurve(*m, curve);
+                            changed = true;
+                        }
+                    }
+                    else {
+                        reply = "error invalid value";
+                    }
+                }
+                else {
+                    reply = "error unknown field";
+                }
+            }
+        }
+
+        result += reply + "\n";
+    }
+
+    return result;
+}
+
+std::string Control::execute(const std::string& commands, bool& subscribed) {
+    bool changed = false;
+    std::string result = executeCommands(commands, changed, &subscribed);
+    if (changed && this->monitorsChanged) {
+        this->monitorsChanged();
+    }
+    return result;
+}
+
+LRESULT CALLBACK Control::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg == WM_CONTROL_EXECUTE) {
+        auto it = hwndToInstance.find(hwnd);
+        auto command = reinterpret_cast<Command*>(lParam);
+        if (it != hwndToInstance.end() && !it->second->quit) {
+            *command->response = it->second->execute(*command->request, *command->subscribed);
+        }
+        else {
+            *command->response = "error shutting down\n";
+        }
+        return 0;
+    }
+
+    return DefWindowProc(hwnd, msg, wParam, lParam);
+}
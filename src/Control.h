@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dimmer {
+    /* runs a batch of control commands against the current settings and
+    returns the reply, one line per command. `changed` is set if any setting
+    was modified. `subscribe` and `unsubscribe` are only understood when
+    `subscribed` is given; they set it. must be called on the ui thread. */
+    extern std::string executeCommands(
+        const std::string& commands, bool& changed, bool* subscribed = nullptr);
+
+    /* a local control endpoint (\\.\pipe\dimmer-<session id>) that only the
+    user running dimmer can open. each message is a batch of newline or
+    semicolon separated commands, and the reply contains one line per
+    command. several clients can be connected at once; see Control.cpp for
+    the command set and subscriptions. */
+    class Control {
+        using MonitorsChanged = std::function<void()>;
+
+        public:
+            /* `pipeName` defaults to the session's pipe. */
+            Control(
+                HINSTANCE instance,
+                MonitorsChanged callback,
+                const std::wstring& pipeName = std::wstring());
+
+            ~Control();
+
+            /* tells every subscribed client that the state changed. call
+            after the overlays and status segment have been updated. */
+            static void notifySubscribers();
+
+        private:
+            struct Client {
+                HANDLE pipe;
+                HANDLE changed; /* auto-reset, set by notifySubscribers() */
+                std::thread thread;
+            };
+
+            static LRESULT CALLBACK windowProc(
+                HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+            void clientProc(Client& client);
+            bool complete(HANDLE pipe, BOOL started, OVERLAPPED& io, DWORD& bytes, DWORD timeout);
+            std::string execute(const std::string& commands, bool& subscribed);
+
+            HWND hwnd;
+            HANDLE stopEvent;
+            std::atomic<bool> quit;
+            std::vector<std::unique_ptr<Client>> clients;
+            MonitorsChanged monitorsChanged;
+    };
+}
@@ -0,0 +1,265 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Focus.h"
+#include "Monitor.h"
+#include <algorithm>
+
+using namespace dimmer;
+
+/* how long a new target has to hold before we switch to it. moving the
+pointer across a monitor on the way somewhere else shouldn't dim anything. */
+constexpr UINT settleMs = 250;
+
+/* how often the pointer's monitor is checked. there's no cheap event for
+the pointer crossing monitors: EVENT_OBJECT_LOCATIONCHANGE, a low-level
+mouse hook and raw input all deliver every pointer movement in the session
+to us, which costs far more than four GetCursorPos() calls a second. the
+poll only runs while focus follow is on and there's more than one monitor
+for the pointer to move to. */
+constexpr UINT cursorPollMs = 250;
+
+/* the switch is faded in six steps, one every fadeIntervalMs. */
+constexpr UINT fadeIntervalMs = 30;
+constexpr float fadeStep = 1.0f / 6.0f;
+
+static FocusFollow* instance = nullptr;
+
+static bool enabled() {
+    return isDimmerEnabled() && isFocusFollowEnabled();
+}
+
+static HMONITOR foregroundMonitor() {
+    HWND foreground = GetForegroundWindow();
+    if (!foreground) {
+        return nullptr;
+    }
+
+    /* the tray menu and our overlays shouldn't move the focus anywhere */
+    DWORD pid = 0;
+    GetWindowThreadProcessId(foreground, &pid);
+    if (pid == GetCurrentProcessId()) {
+        return nullptr;
+    }
+
+    return MonitorFromWindow(foreground, MONITOR_DEFAULTTONULL);
+}
+
+static HMONITOR cursorMonitor() {
+    POINT pt = {};
+    if (!GetCursorPos(&pt)) {
+        return nullptr;
+    }
+    return MonitorFromPoint(pt, MONITOR_DEFAULTTONULL);
+}
+
+FocusFollow::FocusFollow(MonitorsChanged callback, OpacityChanged opacityChanged)
+: foregroundHook(nullptr)
+, moveSizeHook(nullptr)
+, focused(nullptr)
+, pending(nullptr)
+, settleTimerId(0)
+, fadeTimerId(0)
+, cursorTimerId(0)
+, monitorsChanged(callback)
+, opacityChanged(opacityChanged) {
+    ::instance = this;
+    this->update();
+}
+
+FocusFollow::~FocusFollow() {
+    this->unhook();
+    this->killTimer(this->settleTimerId);
+    this->killTimer(this->fadeTimerId);
+    this->killTimer(this->cursorTimerId);
+    ::instance = nullptr;
+}
+
+void FocusFollow::update() {
+    this->monitors = queryMonitors();
+
+    if (enabled()) {
+        if (!this->foregroundHook) {
+            this->hook();
+
+            /* start from wherever the user is right now, without waiting
+            for the settle period. */
+            HMONITOR current = foregroundMonitor();
+            this->focused = current ? current : cursorMonitor();
+            this->pending = nullptr;
+        }
+    }
+    else {
+        this->unhook();
+        this->killTimer(this->settleTimerId);
+        this->killTimer(this->fadeTimerId);
+        this->focused = this->pending = nullptr;
+    }
+
+    /* update() also runs after display changes, so this follows monitors
+    being attached and detached. */
+    if (enabled() && this->monitors.size() > 1) {
+        if (!this->cursorTimerId) {
+            this->cursorTimerId = SetTimer(nullptr, 0, cursorPollMs, &FocusFollow::timerProc);
+        }
+    }
+    else {
+        this->killTimer(this->cursorTimerId);
+    }
+
+    /* applied immediately; callers refresh the overlays themselves. */
+    while (this->fade()) {
+    }
+}
+
+void FocusFollow::hook() {
+    this->foregroundHook = SetWinEventHook(
+        EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND,
+        nullptr, &FocusFollow::eventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+
+    /* the foreground window being dragged onto another monitor */
+    this->moveSizeHook = SetWinEventHook(
+        EVENT_SYSTEM_MOVESIZEEND, EVENT_SYSTEM_MOVESIZEEND,
+        nullptr, &FocusFollow::eventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+}
+
+void FocusFollow::unhook() {
+    if (this->foregroundHook) {
+        UnhookWinEvent(this->foregroundHook);
+        this->foregroundHook = nullptr;
+    }
+    if (this->moveSizeHook) {
+        UnhookWinEvent(this->moveSizeHook);
+        this->moveSizeHook = nullptr;
+    }
+}
+
+void FocusFollow::killTimer(UINT_PTR& id) {
+    if (id) {
+        KillTimer(nullptr, id);
+        id = 0;
+    }
+}
+
+/* called for every event and cursor check, so the common case (the focus
+hasn't left the current monitor) has to be cheap. */
+void FocusFollow::propose(HMONITOR monitor) {
+    if (!monitor || monitor == this->pending) {
+        return;
+    }
+
+    if (monitor == this->focused) {
+        /* came back before the settle period was up */
+        this->pending = nullptr;
+        this->killTimer(this->settleTimerId);
+        return;
+    }
+
+    this->pending = monitor;
+    this->killTimer(this->settleTimerId);
+    this->settleTimerId = SetTimer(nullptr, 0, settleMs, &FocusFollow::timerProc);
+}
+
+void FocusFollow::startFade() {
+    if (!this->fadeTimerId) {
+        this->fadeTimerId = SetTimer(nullptr, 0, fadeIntervalMs, &FocusFollow::timerProc);
+    }
+}
+
+/* moves every monitor's focus dim one step towards its target; returns
+true if anything changed. works on the monitors from the last update() or
+focus switch, so fade steps never enumerate displays. */
+bool FocusFollow::fade() {
+    const bool active = enabled() && this->focused;
+
+    bool changed = false;
+    for (auto& monitor : this->monitors) {
+        const float target = (active && monitor.handle != this->focused) ? 1.0f : 0.0f;
+        const float current = getMonitorFocusDim(monitor);
+        if (current != target) {
+            const float next = (target > current)
+                ? std::min(target, current + fadeStep)
+                : std::max(target, current - fadeStep);
+            setMonitorFocusDim(monitor, next);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void CALLBACK FocusFollow::timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    auto self = ::instance;
+    if (!self) {
+        return;
+    }
+
+    if (id == self->settleTimerId) {
+        self->killTimer(self->settleTimerId);
+        self->focused = self->pending;
+        self->pending = nullptr;
+        self->monitors = queryMonitors();
+        self->startFade();
+    }
+    else if (id == self->fadeTimerId) {
+        /* intermediate steps only touch overlay opacity; the full update
+        (gamma ramps included) runs once the fade is done. */
+        if (self->fade()) {
+            self->opacityChanged();
+        }
+        else {
+            self->killTimer(self->fadeTimerId);
+            self->monitorsChanged();
+        }
+    }
+    else if (id == self->cursorTimerId) {
+        self->propose(cursorMonitor());
+    }
+}
+
+void CALLBACK FocusFollow::eventProc(
+    HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject,
+    LONG idChild, DWORD thread, DWORD time)
+{
+    if (!::instance || idChild != CHILDID_SELF) {
+        return;
+    }
+
+    if (event == EVENT_SYSTEM_FOREGROUND) {
+        ::instance->propose(foregroundMonitor());
+    }
+    else if (idObject == OBJID_WINDOW && hwnd == GetForegroundWindow()) {
+        ::instance->propose(foregroundMonitor());
+    }
+}
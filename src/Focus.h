@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <functional>
+#include <vector>
+#include "Monitor.h"
+
+namespace dimmer {
+    /* dims every monitor except the one being worked on down towards
+    getUnfocusedOpacity(). the focused monitor is whichever one most
+    recently received the foreground window (reported by WinEvent hooks) or
+    the mouse pointer (checked a few times a second, with more than one
+    monitor attached). a target has to hold for a short settle period
+    before it's adopted, and the change is faded in. fade steps only call
+    `opacityChanged`, which should just refresh overlay opacity; `callback`
+    runs once the fade is done. */
+    class FocusFollow {
+        using MonitorsChanged = std::function<void()>;
+        using OpacityChanged = std::function<void()>;
+
+        public:
+            FocusFollow(MonitorsChanged callback, OpacityChanged opacityChanged);
+            ~FocusFollow();
+
+            /* installs or removes the hooks to match the current settings. */
+            void update();
+
+        private:
+            static void CALLBACK eventProc(
+                HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject,
+                LONG idChild, DWORD thread, DWORD time);
+
+            static void CALLBACK timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+
+            void hook();
+            void unhook();
+            void propose(HMONITOR monitor);
+            void startFade();
+            bool fade();
+            void killTimer(UINT_PTR& id);
+
+            HWINEVENTHOOK foregroundHook;
+            HWINEVENTHOOK moveSizeHook;
+            HMONITOR focused;
+            HMONITOR pending;
+            UINT_PTR settleTimerId;
+            UINT_PTR fadeTimerId;
+            UINT_PTR cursorTimerId;
+            std::vector<Monitor> monitors;
+            MonitorsChanged monitorsChanged;
+            OpacityChanged opacityChanged;
+    };
+}
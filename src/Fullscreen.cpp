@@ -0,0 +1,212 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Fullscreen.h"
+#include "Monitor.h"
+#include <algorithm>
+
+using namespace dimmer;
+
+static FullscreenDetector* instance = nullptr;
+
+static bool enabled() {
+    return isDimmerEnabled() && getFullscreenPolicy() != FullscreenPolicy::Overlay;
+}
+
+/* the desktop and shell windows span the whole monitor but obviously
+aren't fullscreen apps; neither are our own overlays. */
+static bool isCandidate(HWND hwnd) {
+    if (!hwnd || hwnd == GetDesktopWindow() || hwnd == GetShellWindow()) {
+        return false;
+    }
+
+    DWORD pid = 0;
+    GetWindowThreadProcessId(hwnd, &pid);
+    if (pid == GetCurrentProcessId()) {
+        return false;
+    }
+
+    wchar_t className[32] = { 0 };
+    GetClassName(hwnd, className, 32);
+    if (!wcscmp(className, L"WorkerW") || !wcscmp(className, L"Progman")) {
+        return false;
+    }
+
+    return IsWindowVisible(hwnd) && !IsIconic(hwnd);
+}
+
+FullscreenDetector::FullscreenDetector(MonitorsChanged callback)
+: foregroundHook(nullptr)
+, locationHook(nullptr)
+, locationThread(0)
+, monitorsChanged(callback) {
+    ::instance = this;
+    this->update();
+}
+
+FullscreenDetector::~FullscreenDetector() {
+    this->unhook();
+    ::instance = nullptr;
+}
+
+void FullscreenDetector::update() {
+    this->monitors = queryMonitors();
+
+    if (enabled()) {
+        this->hook();
+    }
+    else {
+        this->unhook();
+    }
+
+    /* callers refresh the overlays themselves, so the result is unused. */
+    this->check();
+}
+
+void FullscreenDetector::hook() {
+    if (!this->foregroundHook) {
+        /* out of context: the callbacks are delivered to this thread's
+        message loop, nothing is injected into other processes. */
+        this->foregroundHook = SetWinEventHook(
+            EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND,
+            nullptr, &FullscreenDetector::eventProc, 0, 0,
+            WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+
+        this->watchLocation(GetForegroundWindow());
+    }
+}
+
+void FullscreenDetector::unhook() {
+    if (this->foregroundHook) {
+        UnhookWinEvent(this->foregroundHook);
+        this->foregroundHook = nullptr;
+    }
+    this->watchLocation(nullptr);
+}
+
+/* covers windows that go fullscreen (or leave it) while they are already
+in the foreground, e.g. F11 in a browser. a global location hook would
+deliver every move of every window (caret and cursor objects included) to
+our message loop, so it's scoped to the foreground window's thread. */
+void FullscreenDetector::watchLocation(HWND foreground) {
+    DWORD pid = 0;
+    const DWORD thread = isCandidate(foreground)
+        ? GetWindowThreadProcessId(foreground, &pid) : 0;
+
+    if (thread == this->locationThread) {
+        return;
+    }
+
+    if (this->locationHook) {
+        UnhookWinEvent(this->locationHook);
+        this->locationHook = nullptr;
+    }
+
+    this->locationThread = thread;
+
+    if (thread) {
+        this->locationHook = SetWinEventHook(
+            EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE,
+            nullptr, &FullscreenDetector::eventProc, pid, thread,
+            WINEVENT_OUTOFCONTEXT);
+    }
+}
+
+/* updates the per-monitor flags; returns true if any of them changed. */
+bool FullscreenDetector::check() {
+    HWND foreground = enabled() ? GetForegroundWindow() : nullptr;
+
+    HMONITOR covered = nullptr;
+    if (isCandidate(foreground)) {
+        RECT rect = {};
+        GetWindowRect(foreground, &rect);
+
+        /* the monitors are cached at update(); a handle we don't know means
+        the displays changed since, so the list is refreshed once. */
+        HMONITOR handle = MonitorFromWindow(foreground, MONITOR_DEFAULTTONULL);
+        auto find = [this, handle]() {
+            return std::find_if(this->monitors.begin(), this->monitors.end(),
+                [handle](const Monitor& m) { return m.handle == handle; });
+        };
+
+        auto it = find();
+        if (handle && it == this->monitors.end()) {
+            this->monitors = queryMonitors();
+            it = find();
+        }
+
+        if (it != this->monitors.end()) {
+            const RECT& bounds = it->info.rcMonitor;
+            if (rect.left <= bounds.left && rect.top <= bounds.top &&
+                rect.right >= bounds.right && rect.bottom >= bounds.bottom)
+            {
+                covered = handle;
+            }
+        }
+    }
+
+    bool changed = false;
+    for (auto& monitor : this->monitors) {
+        const bool fullscreen = (monitor.handle == covered);
+        if (isMonitorFullscreen(monitor) != fullscreen) {
+            setMonitorFullscreen(monitor, fullscreen);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void CALLBACK FullscreenDetector::eventProc(
+    HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject,
+    LONG idChild, DWORD thread, DWORD time)
+{
+    if (!::instance || idObject != OBJID_WINDOW || idChild != CHILDID_SELF) {
+        return;
+    }
+
+    /* the foreground thread's other windows move too; only the foreground
+    window itself can change the answer. */
+    if (event == EVENT_OBJECT_LOCATIONCHANGE && hwnd != GetForegroundWindow()) {
+        return;
+    }
+
+    if (event == EVENT_SYSTEM_FOREGROUND) {
+        ::instance->watchLocation(hwnd);
+    }
+
+    if (::instance->check()) {
+        ::instance->monitorsChanged();
+    }
+}
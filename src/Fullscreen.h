@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <functional>
+#include <vector>
+#include "Monitor.h"
+
+namespace dimmer {
+    /* tracks which monitors are covered by a fullscreen foreground window
+    and flags them with setMonitorFullscreen(). what that does to dimming
+    is decided by getFullscreenPolicy(). driven entirely by WinEvent hooks;
+    with the default policy no hooks are installed at all. location changes
+    are only watched for the foreground window's thread, re-hooked whenever
+    the foreground changes, so other windows moving around never wake us. */
+    class FullscreenDetector {
+        using MonitorsChanged = std::function<void()>;
+
+        public:
+            FullscreenDetector(MonitorsChanged callback);
+            ~FullscreenDetector();
+
+            /* installs or removes the hooks to match the current settings. */
+            void update();
+
+        private:
+            static void CALLBACK eventProc(
+                HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject,
+                LONG idChild, DWORD thread, DWORD time);
+
+            void hook();
+            void unhook();
+            void watchLocation(HWND foreground);
+            bool check();
+
+            HWINEVENTHOOK foregroundHook;
+            HWINEVENTHOOK locationHook;
+            DWORD locationThread;
+            std::vector<Monitor> monitors;
+            MonitorsChanged monitorsChanged;
+    };
+}
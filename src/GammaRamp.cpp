@@ -0,0 +1,302 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "GammaRamp.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <tuple>
+
+using namespace dimmer;
+
+/* entries are never modified after they're built. curves are immutable and
+compared by identity; holding a reference in the key keeps the address from
+being reused by a different curve. */
+using RampKey = std::tuple<ToneCurvePtr, int, int>;
+
+struct CachedRamp {
+    GammaRamp ramp;
+    bool prepared;
+};
+
+static std::map<RampKey, CachedRamp> gammaRamps;
+static size_t unpreparedCount = 0;
+
+static void buildRamp(const RampKey& key, GammaRamp& ramp) {
+    const int temperature = std::get<1>(key);
+    const int brightness = std::get<2>(key);
+
+    float scale[3] = { 1.0f, 1.0f, 1.0f };
+    if (temperature != -1) {
+        colorTemperatureToRgb(temperature, scale[0], scale[1], scale[2]);
+    }
+
+    for (int c = 0; c < 3; c++) {
+        scale[c] *= (float) brightness / 100.0f;
+    }
+
+    compileToneCurve(std::get<0>(key).get(), scale, ramp.values);
+}
+
+static uint32_t bigEndian32(const std::string& data, size_t offset) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static uint16_t bigEndian16(const std::string& data, size_t offset) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+    return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+namespace dimmer {
+    void identityRamp(GammaRamp& ramp) {
+        for (int c = 0; c < 3; c++) {
+            for (int i = 0; i < 256; i++) {
+                ramp.values[c][i] = (WORD) (i * 257);
+            }
+        }
+    }
+
+    bool isIdentityRamp(const GammaRamp& ramp) {
+        for (int c = 0; c < 3; c++) {
+            for (int i = 0; i < 256; i++) {
+                if (std::abs((int) ramp.values[c][i] - i * 257) > 256) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    uint64_t hashRamp(const GammaRamp& ramp) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(ramp.values);
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(ramp.values); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    void composeRamp(const GammaRamp& baseline, const GammaRamp& ramp, GammaRamp& out) {
+        for (int c = 0; c < 3; c++) {
+            const WORD* b = baseline.values[c];
+            for (int i = 0; i < 256; i++) {
+                const uint32_t position = (uint32_t) ramp.values[c][i] * 255;
+                const uint32_t index = position / 65535;
+                const uint32_t fraction = position % 65535;
+                if (index >= 255) {
+                    out.values[c][i] = b[255];
+                }
+                else {
+                    const int64_t delta = (int64_t) b[index + 1] - (int64_t) b[index];
+                    out.values[c][i] = (WORD) (b[index] + delta * (int64_t) fraction / 65535);
+                }
+            }
+        }
+    }
+
+    bool parseProfileRamp(const std::string& icc, GammaRamp& ramp) {
+        if (icc.size() < 132) {
+            return false;
+        }
+
+        const uint32_t tagCount = bigEndian32(icc, 128);
+        size_t offset = 0, length = 0;
+        for (uint32_t t = 0; t < tagCount && 132 + (t + 1) * 12 <= icc.size(); t++) {
+            const size_t entry = 132 + t * 12;
+            if (bigEndian32(icc, entry) == 0x76636774) { /* 'vcgt' */
+                offset = bigEndian32(icc, entry + 4);
+                length = bigEndian32(icc, entry + 8);
+                break;
+            }
+        }
+
+        if (length < 12 || offset + length > icc.size() || offset + length < offset) {
+            return false;
+        }
+
+        const uint32_t type = bigEndian32(icc, offset + 8);
+
+        if (type == 0) { /* table */
+            if (length < 18) {
+                return false;
+            }
+            const uint16_t channels = bigEndian16(icc, offset + 12);
+            const uint16_t entries = bigEndian16(icc, offset + 14);
+            const uint16_t entrySize = bigEndian16(icc, offset + 16);
+            if ((channels != 1 && channels != 3) || entries < 2 ||
+                (entrySize != 1 && entrySize != 2) ||
+                18 + (size_t) channels * entries * entrySize > length)
+            {
+                return false;
+            }
+
+            for (int c = 0; c < 3; c++) {
+                const size_t table = offset + 18 + (size_t) (channels == 3 ? c : 0) * entries * entrySize;
+                auto at = [&](size_t index) -> int64_t {
+                    return (entrySize == 2)
+                        ? bigEndian16(icc, table + index * 2)
+                        : (uint8_t) icc[table + index] * 257;
+                };
+                for (int i = 0; i < 256; i++) {
+                    const size_t position = (size_t) i * (entries - 1);
+                    const size_t index = position / 255;
+                    const int64_t fraction = position % 255;
+                    const int64_t a = at(index);
+                    const int64_t b = (index + 1 < entries) ? at(index + 1) : a;
+                    ramp.values[c][i] = (WORD) (a + (b - a) * fraction / 255);
+                }
+            }
+            return true;
+        }
+
+        if (type == 1) { /* formula: gamma, min, max per channel, s15.16 */
+            if (length < 48) {
+                return false;
+            }
+            for (int c = 0; c < 3; c++) {
+                const size_t base = offset + 12 + c * 12;
+                const double gamma = (int32_t) bigEndian32(icc, base) / 65536.0;
+                const double min = (int32_t) bigEndian32(icc, base + 4) / 65536.0;
+                const double max = (int32_t) bigEndian32(icc, base + 8) / 65536.0;
+                if (gamma <= 0.0) {
+                    return false;
+                }
+                for (int i = 0; i < 256; i++) {
+                    const double v = min + (max - min) * std::pow(i / 255.0, gamma);
+                    ramp.values[c][i] = (WORD) std::round(std::min(1.0, std::max(0.0, v)) * 65535.0);
+                }
+            }
+            return true;
+        }
+
+        return false;
+    }
+
+    void updateBaseline(
+        const std::string& icc,
+        const GammaRamp* current,
+        bool ignoreCurrent,
+        GammaRamp& baseline,
+        bool& hasBaseline)
+    {
+        GammaRamp profile;
+        if (parseProfileRamp(icc, profile)) {
+            baseline = profile;
+            hasBaseline = true;
+            return;
+        }
+
+        if (!current || ignoreCurrent || (hasBaseline && isIdentityRamp(*current))) {
+            if (!hasBaseline) {
+                identityRamp(baseline);
+                hasBaseline = true;
+            }
+            return;
+        }
+
+        baseline = *current;
+        hasBaseline = true;
+    }
+
+    const GammaRamp& getGammaRamp(const ToneCurvePtr& curve, int temperature, int brightness) {
+        const RampKey key(curve, temperature, brightness);
+        auto it = gammaRamps.find(key);
+        if (it != gammaRamps.end()) {
+            return it->second.ramp;
+        }
+
+        if (unpreparedCount >= maxUnpreparedRamps) {
+            for (auto r = gammaRamps.begin(); r != gammaRamps.end();) {
+                r = r->second.prepared ? std::next(r) : gammaRamps.erase(r);
+            }
+            unpreparedCount = 0;
+        }
+
+        CachedRamp& entry = gammaRamps[key];
+        entry.prepared = false;
+        buildRamp(key, entry.ramp);
+        ++unpreparedCount;
+        return entry.ramp;
+    }
+
+    void prepareGammaRamps(
+        const std::vector<std::pair<ToneCurvePtr, int>>& settings,
+        const std::vector<int>& brightness)
+    {
+        std::set<RampKey> wanted;
+        for (auto& setting : settings) {
+            for (int b : brightness) {
+                wanted.insert(RampKey(setting.first, setting.second, b));
+            }
+        }
+
+        for (auto it = gammaRamps.begin(); it != gammaRamps.end();) {
+            if (wanted.find(it->first) == wanted.end()) {
+                it = gammaRamps.erase(it);
+            }
+            else {
+                it->second.prepared = true;
+                ++it;
+            }
+        }
+
+        for (auto& key : wanted) {
+            auto it = gammaRamps.find(key);
+            if (it == gammaRamps.end()) {
+                CachedRamp& entry = gammaRamps[key];
+                entry.prepared = true;
+                buildRamp(key, entry.ramp);
+            }
+        }
+
+        unpreparedCount = 0;
+    }
+
+    bool isCachedRamp(const GammaRamp& ramp) {
+        for (auto& it : gammaRamps) {
+            if (memcmp(it.second.ramp.values, ramp.values, sizeof(ramp.values)) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t getCachedRampCount() {
+        return gammaRamps.size();
+    }
+}
@@ -0,0 +1,107 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include "ToneCurve.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* gamma ramp arithmetic and the ramp cache: everything about ramps that
+doesn't touch a device, shared by the overlays, the bench and the tests. */
+
+namespace dimmer {
+    struct GammaRamp {
+        WORD values[3][256];
+    };
+
+    extern void identityRamp(GammaRamp& ramp);
+
+    /* within one 8 bit step, since drivers may quantize */
+    extern bool isIdentityRamp(const GammaRamp& ramp);
+
+    /* 64 bit fnv-1a over the raw ramp */
+    extern uint64_t hashRamp(const GammaRamp& ramp);
+
+    /* runs our ramp through the device's calibration ramp: out =
+    baseline(ramp), linearly interpolating between the 256 baseline entries.
+    with an identity baseline this reproduces `ramp` exactly. */
+    extern void composeRamp(const GammaRamp& baseline, const GammaRamp& ramp, GammaRamp& out);
+
+    /* reads the calibration curves from the vcgt tag of an ICC profile's
+    contents: either a table of 8 or 16 bit entries (one or three channels,
+    any length, resampled to 256), or a gamma/min/max formula per channel.
+    returns false if the profile has no usable vcgt tag. */
+    extern bool parseProfileRamp(const std::string& icc, GammaRamp& ramp);
+
+    /* updates the remembered calibration. the profile's vcgt curves win when
+    `icc` has them; otherwise the ramp the device currently has (`current`,
+    null if it couldn't be read), unless that's evidently not a calibration:
+    `ignoreCurrent` (it's one of our own ramps), or a plain identity ramp
+    while we already have a baseline (the driver reset it after a mode
+    change, and the calibration we have is still the right one). without
+    anything better, the first baseline is the identity. */
+    extern void updateBaseline(
+        const std::string& icc,
+        const GammaRamp* current,
+        bool ignoreCurrent,
+        GammaRamp& baseline,
+        bool& hasBaseline);
+
+    /* ramps only depend on the tone curve, temperature (-1 for none) and
+    brightness (a percentage; below 100 scales the whole ramp down), so each
+    one is built once and shared by every overlay that uses it. the
+    reference is only good until the next call into the cache. */
+    extern const GammaRamp& getGammaRamp(const ToneCurvePtr& curve, int temperature, int brightness);
+
+    /* makes the cache hold the ramps for every (curve, temperature) in
+    `settings` at every level in `brightness`, building the missing ones and
+    dropping everything else, so ramps for settings that are gone don't
+    pile up. ramps asked for outside of this (a curve with its temperature
+    suspended, say) are built on demand, and dropped in bulk once
+    maxUnpreparedRamps of them exist. */
+    constexpr size_t maxUnpreparedRamps = 64;
+    extern void prepareGammaRamps(
+        const std::vector<std::pair<ToneCurvePtr, int>>& settings,
+        const std::vector<int>& brightness);
+
+    /* true if `ramp` is one of the cached ramps. with an identity
+    calibration that's exactly what we submit, so reading it back means we
+    (or an instance that didn't get to restore the ramp) left it there. */
+    extern bool isCachedRamp(const GammaRamp& ramp);
+    extern size_t getCachedRampCount();
+}
@@ -0,0 +1,157 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "GammaWatch.h"
+#include <WtsApi32.h>
+#include <algorithm>
+
+#pragma comment(lib, "Wtsapi32.lib")
+
+using namespace dimmer;
+
+constexpr wchar_t className[] = L"DimmerGammaWatchClass";
+
+/* drivers finish resetting a little after they announce the event */
+constexpr UINT settleMs = 500;
+
+static ATOM watchClass = 0;
+static GammaWatch* instance = nullptr;
+
+static void registerClass(HINSTANCE instance, WNDPROC wndProc) {
+    if (!watchClass) {
+        WNDCLASS wc = {};
+        wc.lpfnWndProc = wndProc;
+        wc.hInstance = instance;
+        wc.lpszClassName = className;
+        watchClass = RegisterClass(&wc);
+    }
+}
+
+namespace dimmer {
+    UINT nextGammaPollMs(UINT intervalMs, size_t restored) {
+        if (restored > 0) {
+            return minGammaPollMs;
+        }
+        /* compared against half the cap so the doubling can't overflow */
+        return (intervalMs >= maxGammaPollMs / 2)
+            ? maxGammaPollMs : std::max(minGammaPollMs, intervalMs * 2);
+    }
+}
+
+GammaWatch::GammaWatch(HINSTANCE instance, Verify verify)
+: hwnd(nullptr)
+, timerId(0)
+, pollIntervalMs(minGammaPollMs)
+, verify(verify) {
+    ::instance = this;
+
+    registerClass(instance, &windowProc);
+
+    /* a hidden top-level window rather than a message-only one: only
+    top-level windows receive WM_POWERBROADCAST and WM_DISPLAYCHANGE. */
+    this->hwnd = CreateWindowEx(
+        0, className, L"", 0, 0, 0, 0, 0, nullptr, nullptr, instance, nullptr);
+
+    WTSRegisterSessionNotification(this->hwnd, NOTIFY_FOR_THIS_SESSION);
+    this->update();
+}
+
+GammaWatch::~GammaWatch() {
+    if (this->timerId) {
+        KillTimer(nullptr, this->timerId);
+    }
+    WTSUnRegisterSessionNotification(this->hwnd);
+    DestroyWindow(this->hwnd);
+    ::instance = nullptr;
+}
+
+void GammaWatch::update() {
+    if (!this->timerId) {
+        this->schedule(this->pollIntervalMs);
+    }
+}
+
+void GammaWatch::schedule(UINT delayMs) {
+    if (this->timerId) {
+        KillTimer(nullptr, this->timerId);
+    }
+    this->timerId = SetTimer(nullptr, 0, delayMs, &GammaWatch::timerProc);
+}
+
+void GammaWatch::check() {
+    KillTimer(nullptr, this->timerId);
+    this->timerId = 0;
+
+    bool active = false;
+    this->pollIntervalMs = nextGammaPollMs(this->pollIntervalMs, this->verify(active));
+
+    /* with nothing but calibration ramps applied there's nothing to lose;
+    the next event or settings change schedules us again. */
+    if (active) {
+        this->schedule(this->pollIntervalMs);
+    }
+}
+
+void CALLBACK GammaWatch::timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    if (::instance && id == ::instance->timerId) {
+        ::instance->check();
+    }
+}
+
+LRESULT CALLBACK GammaWatch::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (::instance) {
+        bool suspect = false;
+
+        switch (msg) {
+            case WM_DISPLAYCHANGE:
+                suspect = true;
+                break;
+
+            case WM_POWERBROADCAST:
+                suspect = (wParam == PBT_APMRESUMEAUTOMATIC || wParam == PBT_APMRESUMESUSPEND);
+                break;
+
+            case WM_WTSSESSION_CHANGE:
+                suspect = (wParam == WTS_SESSION_UNLOCK || wParam == WTS_CONSOLE_CONNECT);
+                break;
+        }
+
+        if (suspect) {
+            ::instance->pollIntervalMs = minGammaPollMs;
+            ::instance->schedule(settleMs);
+        }
+    }
+
+    return DefWindowProc(hwnd, msg, wParam, lParam);
+}
@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <functional>
+
+namespace dimmer {
+    /* drivers quietly reset gamma ramps on resume, after a GPU reset, or on
+    some mode switches. this re-verifies the ramps shortly after any power,
+    display or session event that could have done it, and, as a fallback
+    for resets nothing tells us about, every so often with a backoff. */
+    /* the fallback poll starts at minGammaPollMs, doubles after every
+    clean check up to maxGammaPollMs, and drops back down as soon as a ramp
+    had to be restored. returns the interval to wait after a check that
+    restored `restored` ramps, given the one it waited before it. */
+    constexpr UINT minGammaPollMs = 10 * 1000;
+    constexpr UINT maxGammaPollMs = 10 * 60 * 1000;
+    extern UINT nextGammaPollMs(UINT intervalMs, size_t restored);
+
+    class GammaWatch {
+        public:
+            /* re-checks every monitor and returns how many ramps it had to
+            restore; sets `active` if any of them has a ramp worth
+            protecting. */
+            using Verify = std::function<size_t(bool& active)>;
+
+            GammaWatch(HINSTANCE instance, Verify verify);
+            ~GammaWatch();
+
+            /* makes sure a check is scheduled; call after settings change. */
+            void update();
+
+        private:
+            static LRESULT CALLBACK windowProc(
+                HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+            static void CALLBACK timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+
+            void schedule(UINT delayMs);
+            void check();
+
+            HWND hwnd;
+            UINT_PTR timerId;
+            UINT pollIntervalMs;
+            Verify verify;
+    };
+}
@@ -0,0 +1,169 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Idle.h"
+#include "Monitor.h"
+#include <algorithm>
+
+using namespace dimmer;
+
+constexpr wchar_t className[] = L"DimmerIdleClass";
+
+static ATOM idleClass = 0;
+static IdleDimming* instance = nullptr;
+
+static void registerClass(HINSTANCE instance, WNDPROC wndProc) {
+    if (!idleClass) {
+        WNDCLASS wc = {};
+        wc.lpfnWndProc = wndProc;
+        wc.hInstance = instance;
+        wc.lpszClassName = className;
+        idleClass = RegisterClass(&wc);
+    }
+}
+
+static bool enabled() {
+    return isDimmerEnabled() && getIdleTimeout() > 0;
+}
+
+IdleDimming::IdleDimming(HINSTANCE instance, MonitorsChanged callback)
+: hwnd(nullptr)
+, timerId(0)
+, monitorsChanged(callback) {
+    ::instance = this;
+
+    registerClass(instance, &windowProc);
+
+    /* message-only window; it exists to receive WM_INPUT while idle. */
+    this->hwnd = CreateWindowEx(
+        0, className, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, instance, nullptr);
+}
+
+IdleDimming::~IdleDimming() {
+    this->disarm();
+    if (isIdle()) {
+        this->watchInput(false);
+        setIdle(false);
+    }
+    DestroyWindow(this->hwnd);
+    ::instance = nullptr;
+}
+
+void IdleDimming::update() {
+    if (!enabled()) {
+        this->disarm();
+        if (isIdle()) {
+            this->watchInput(false);
+            setIdle(false);
+        }
+    }
+    else if (!isIdle()) {
+        this->arm();
+    }
+}
+
+void IdleDimming::arm() {
+    this->disarm();
+
+    LASTINPUTINFO info = {};
+    info.cbSize = sizeof(info);
+    GetLastInputInfo(&info);
+
+    const DWORD timeout = (DWORD) getIdleTimeout() * 1000u; /* <= 86,400,000 */
+    const DWORD elapsed = GetTickCount() - info.dwTime;
+
+    if (elapsed >= timeout) {
+        this->enterIdle();
+    }
+    else {
+        /* nothing can make us idle before this deadline, so there's no
+        reason to wake up any earlier. */
+        this->timerId = SetTimer(nullptr, 0, timeout - elapsed, &IdleDimming::timerProc);
+    }
+}
+
+void IdleDimming::disarm() {
+    if (this->timerId) {
+        KillTimer(nullptr, this->timerId);
+        this->timerId = 0;
+    }
+}
+
+void IdleDimming::enterIdle() {
+    this->disarm();
+    this->watchInput(true);
+    setIdle(true);
+    this->monitorsChanged();
+}
+
+void IdleDimming::leaveIdle() {
+    this->watchInput(false);
+    setIdle(false);
+    this->monitorsChanged();
+
+    /* the input that woke us may not be reflected by GetLastInputInfo()
+    yet, so start a full timeout from now; arm() re-checks when it fires. */
+    this->disarm();
+    const UINT timeout = (UINT) getIdleTimeout() * 1000u;
+    this->timerId = SetTimer(nullptr, 0, timeout, &IdleDimming::timerProc);
+}
+
+void IdleDimming::watchInput(bool watch) {
+    /* generic desktop page: mouse (2) and keyboard (6). INPUTSINK delivers
+    input even though this window never has focus. */
+    RAWINPUTDEVICE devices[2] = {};
+    for (int i = 0; i < 2; i++) {
+        devices[i].usUsagePage = 0x01;
+        devices[i].usUsage = (i == 0) ? 0x02 : 0x06;
+        devices[i].dwFlags = watch ? RIDEV_INPUTSINK : RIDEV_REMOVE;
+        devices[i].hwndTarget = watch ? this->hwnd : nullptr;
+    }
+    RegisterRawInputDevices(devices, 2, sizeof(RAWINPUTDEVICE));
+}
+
+void CALLBACK IdleDimming::timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    if (::instance) {
+        /* input may have arrived since we armed; arm() either goes idle
+        now or schedules the next deadline. */
+        ::instance->arm();
+    }
+}
+
+LRESULT CALLBACK IdleDimming::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg == WM_INPUT && ::instance && isIdle()) {
+        ::instance->leaveIdle();
+    }
+
+    return DefWindowProc(hwnd, msg, wParam, lParam);
+}
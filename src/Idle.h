@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <functional>
+
+namespace dimmer {
+    /* dims all monitors to the idle opacity after getIdleTimeout() seconds
+    without user input, and restores them on the next input event. nothing
+    polls: a single timer is armed for the earliest moment the session could
+    become idle, and once idle, raw input wakes us up. */
+    class IdleDimming {
+        using MonitorsChanged = std::function<void()>;
+
+        public:
+            IdleDimming(HINSTANCE instance, MonitorsChanged callback);
+            ~IdleDimming();
+
+            /* re-arms or disarms to match the current settings. */
+            void update();
+
+        private:
+            static LRESULT CALLBACK windowProc(
+                HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+            static void CALLBACK timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+
+            void arm();
+            void disarm();
+            void enterIdle();
+            void leaveIdle();
+            void watchInput(bool watch);
+
+            HWND hwnd;
+            UINT_PTR timerId;
+            MonitorsChanged monitorsChanged;
+    };
+}
@@ -0,0 +1,138 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Metrics.h"
+#include "Util.h"
+#include "json.hpp"
+#include <atomic>
+
+using namespace dimmer;
+using namespace dimmer::metrics;
+using namespace nlohmann;
+
+/* bucket i counts samples shorter than 2^i microseconds; the last bucket
+catches everything else (> ~4s). */
+constexpr int bucketCount = 23;
+
+static const char* names[MetricCount] = {
+    "loadConfig",
+    "reloadConfig",
+    "saveConfig",
+    "writeConfig",
+    "queryMonitors",
+    "updateOverlays",
+    "Overlay::update",
+    "createDeviceContext",
+    "applyGammaRamp",
+    "updateOverlayWindow",
+    "createMenu",
+    "verifyGammaRamp",
+    "setBacklight",
+    "rejectGammaRamp"
+};
+
+struct Histogram {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> totalMicros;
+    std::atomic<uint64_t> maxMicros;
+    std::atomic<uint64_t> buckets[bucketCount];
+};
+
+static Histogram histograms[MetricCount];
+
+static int64_t getFrequency() {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return frequency.QuadPart;
+}
+
+namespace dimmer {
+    namespace metrics {
+        void record(Metric metric, int64_t ticks) {
+            static const int64_t frequency = getFrequency();
+
+            uint64_t micros = (uint64_t) ((ticks * 1000000) / frequency);
+
+            int bucket = 0;
+            while (bucket < bucketCount - 1 && (1ull << bucket) <= micros) {
+                ++bucket;
+            }
+
+            Histogram& h = histograms[metric];
+            h.count.fetch_add(1, std::memory_order_relaxed);
+            h.totalMicros.fetch_add(micros, std::memory_order_relaxed);
+            h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+            uint64_t max = h.maxMicros.load(std::memory_order_relaxed);
+            while (micros > max && !h.maxMicros.compare_exchange_weak(max, micros)) {
+                /* retry with the updated max */
+            }
+        }
+
+        const char* name(Metric metric) {
+            return names[metric];
+        }
+
+        std::string snapshot() {
+            json bounds = json::array();
+            for (int i = 0; i < bucketCount - 1; i++) {
+                bounds.push_back(1ull << i);
+            }
+
+            json result = { { "bucketUpperBoundsUs", bounds }, { "metrics", json::object() } };
+            json& m = result["metrics"];
+
+            for (int i = 0; i < MetricCount; i++) {
+                Histogram& h = histograms[i];
+                json buckets = json::array();
+                for (int j = 0; j < bucketCount; j++) {
+                    buckets.push_back(h.buckets[j].load(std::memory_order_relaxed));
+                }
+
+                m[names[i]] = {
+                    { "count", h.count.load(std::memory_order_relaxed) },
+                    { "totalUs", h.totalMicros.load(std::memory_order_relaxed) },
+                    { "maxUs", h.maxMicros.load(std::memory_order_relaxed) },
+                    { "buckets", buckets }
+                };
+            }
+
+            return result.dump();
+        }
+
+        bool dump(const std::wstring& filename) {
+            return stringToFile(filename, snapshot());
+        }
+    }
+}
@@ -0,0 +1,98 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include "Trace.h"
+#include <cstdint>
+#include <string>
+
+namespace dimmer {
+    namespace metrics {
+        /* every instrumented path has a fixed slot, so recording never
+        allocates or looks anything up. keep in sync with names in Metrics.cpp */
+        enum Metric {
+            LoadConfig = 0,
+            ReloadConfig,
+            SaveConfig,
+            WriteConfig,
+            QueryMonitors,
+            UpdateOverlays,
+            UpdateOverlay,
+            CreateDeviceContext,
+            ApplyGammaRamp,
+            UpdateOverlayWindow,
+            CreateMenu,
+            VerifyGammaRamp,
+            SetBacklight,
+            RejectGammaRamp,
+            MetricCount
+        };
+
+        extern void record(Metric metric, int64_t ticks);
+        extern const char* name(Metric metric);
+
+        /* returns all counters and latency histograms as a single line of
+        json. safe to call from any thread. */
+        extern std::string snapshot();
+
+        /* writes snapshot() to `filename`, replacing it. the snapshot is a
+        couple of kilobytes, so this is done in place rather than handed to
+        a writer thread. returns false if the file couldn't be written. */
+        extern bool dump(const std::wstring& filename);
+
+        /* records the lifetime of the enclosing scope against `metric`, and
+        emits it as a trace span if tracing is enabled. */
+        class Scope {
+            public:
+                Scope(Metric metric) : metric(metric) {
+                    QueryPerformanceCounter(&this->start);
+                }
+
+                ~Scope() {
+                    LARGE_INTEGER end;
+                    QueryPerformanceCounter(&end);
+                    record(this->metric, end.QuadPart - this->start.QuadPart);
+                    if (trace::isEnabled()) {
+                        trace::span(name(this->metric), this->start.QuadPart, end.QuadPart);
+                    }
+                }
+
+            private:
+                Metric metric;
+                LARGE_INTEGER start;
+        };
+    }
+}
@@ -34,7 +34,17 @@
 
 #include "Monitor.h"
 #include "Util.h"
+#include "Metrics.h"
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <cwctype>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <ctime>
+#include <cmath>
 #include "json.hpp"
 
 using namespace dimmer;
@@ -42,27 +52,141 @@ using namespace nlohmann;
 
 constexpr float DEFAULT_OPACITY = 0.3f;
 constexpr int DEFAULT_TEMPERATURE = -1;
+constexpr int DEFAULT_BACKLIGHT = -1; /* leave the panel alone */
+constexpr int64_t STALE_DAYS = 90;
 
 struct MonitorOptions {
     float opacity;
     int temperature;
     bool enabled;
+    int backlight;
+    ToneCurvePtr curve;
 
     MonitorOptions() {
         this->opacity = DEFAULT_OPACITY;
         this->temperature = DEFAULT_TEMPERATURE;
         this->enabled = true;
+        this->backlight = DEFAULT_BACKLIGHT;
     }
 };
 
-static std::map<std::wstring, std::shared_ptr<MonitorOptions>> monitorOptions;
+/* transient state, never persisted, and unaffected by profile switches */
+struct MonitorState {
+    float contentScale;
+    bool fullscreen;
+    float focusDim;
+    AppProfilePtr appProfile;
+    bool gammaRejected; /* the device refused our dimmed ramp */
+    bool rampRejected; /* the device refused the last ramp we submitted */
+    int panelMinimum; /* lowest WMI backlight level, -1 if there's none */
+
+    MonitorState() {
+        this->contentScale = 1.0f;
+        this->fullscreen = false;
+        this->focusDim = 0.0f;
+        this->gammaRejected = false;
+        this->rampRejected = false;
+        this->panelMinimum = -1;
+    }
+};
+
+using OptionsMap = std::map<std::wstring, std::shared_ptr<MonitorOptions>>;
+
+constexpr char DEFAULT_PROFILE[] = "default";
+
+/* named profiles, each a complete set of per-monitor options. the default
+profile always exists; it's the top level "monitors" section of the config.
+switching profiles just repoints monitorOptions. */
+static std::map<std::string, OptionsMap> profiles = { { DEFAULT_PROFILE, OptionsMap() } };
+static std::string activeProfile = DEFAULT_PROFILE;
+static OptionsMap* monitorOptions = &profiles[DEFAULT_PROFILE];
+
+static std::map<std::wstring, MonitorState> monitorStates;
+
+/* the day (since the unix epoch) each monitor id was last connected. ids
+include the enumeration index, so docks and port changes keep producing new
+ones; settings for ids that haven't been seen in STALE_DAYS are dropped when
+the config is saved. */
+static std::map<std::wstring, int64_t> lastSeen;
+static std::unordered_map<std::wstring, AppProfilePtr> appProfiles;
 static bool pollingEnabled = false;
 static bool globalEnabled = true;
+static bool adaptiveEnabled = false;
+static bool ambientEnabled = false;
+static float ambientScale = 1.0f;
+static int idleTimeout = 0;
+static float idleOpacity = 0.7f;
+static bool idle = false;
+static FullscreenPolicy fullscreenPolicy = FullscreenPolicy::Overlay;
+static bool panelDimmingEnabled = false;
+static bool focusFollowEnabled = false;
+static float unfocusedOpacity = 0.5f;
+
+static const char* fullscreenPolicyNames[] = { "overlay", "gamma", "suspend" };
+
+static std::mutex writerMutex;
+static std::condition_variable writerCondition;
+static std::thread writerThread;
+static std::string pendingConfig;
+static bool configPending = false;
+static bool writerRunning = false;
+
+/* the config.json contents we most recently loaded or queued ourselves,
+and (guarded by writerMutex) the contents the writer thread most recently
+put on disk. the writer can land an older config after a newer one was
+queued, so both are needed to tell our own writes apart from external
+edits. */
+static std::string lastConfig;
+static std::string writtenConfig;
+static unsigned queuedGeneration = 0;
+static unsigned writtenGeneration = 0;
+
+static int batchDepth = 0;
+static bool batchDirty = false;
 
 static std::wstring getConfigFilename() {
     return getDataDirectory() + L"\\config.json";
 }
 
+/* disk writes happen here, off the ui thread. only the newest pending
+config is kept; anything it superseded is never written. */
+static void configWriterProc() {
+    const std::wstring filename = getConfigFilename();
+    std::unique_lock<std::mutex> lock(writerMutex);
+    while (true) {
+        writerCondition.wait(lock, [] { return configPending || !writerRunning; });
+        if (configPending) {
+            std::string contents;
+            std::swap(contents, pendingConfig);
+            unsigned generation = queuedGeneration;
+            configPending = false;
+            lock.unlock();
+            {
+                metrics::Scope scope(metrics::WriteConfig);
+                stringToFile(filename, contents);
+            }
+            lock.lock();
+            writtenConfig = std::move(contents);
+            writtenGeneration = generation;
+        }
+        else {
+            break;
+        }
+    }
+}
+
+static void queueConfigWrite(std::string&& contents) {
+    std::unique_lock<std::mutex> lock(writerMutex);
+    pendingConfig = std::move(contents);
+    configPending = true;
+    ++queuedGeneration;
+    if (!writerRunning) {
+        writerRunning = true;
+        writerThread = std::thread(&configWriterProc);
+    }
+    writerCondition.notify_one();
+}
+
 static BOOL CALLBACK MonitorEnumProc(HMONITOR monitor, HDC hdc, LPRECT rect, LPARAM data) {
     auto monitors = reinterpret_cast<std::vector<Monitor>*>(data);
     int index = (int) monitors->size();
@@ -71,15 +195,351 @@ static BOOL CALLBACK MonitorEnumProc(HMONITOR monitor, HDC hdc, LPRECT rect, LPA
 }
 
 static MonitorOptions& options(Monitor& monitor) {
-    auto id = monitor.getId();
-    if (monitorOptions.find(id) == monitorOptions.end()) {
-        monitorOptions[id] = std::make_shared<MonitorOptions>();
+    auto& result = (*monitorOptions)[monitor.getId()];
+    if (!result) {
+        result = std::make_shared<MonitorOptions>();
+    }
+    return *result;
+}
+
+static MonitorState& state(Monitor& monitor) {
+    return monitorStates[monitor.getId()];
+}
+
+/* returns true if the active profile changed. unknown names are ignored;
+profiles only come into existence through createProfile() or config.json. */
+static bool selectProfile(const std::string& name) {
+    if (name == activeProfile) {
+        return false;
+    }
+
+    auto it = profiles.find(name);
+    if (it == profiles.end()) {
+        return false;
+    }
+
+    activeProfile = name;
+    monitorOptions = &it->second;
+    return true;
+}
+
+template <typename T>
+static bool assign(T& target, const T& value) {
+    if (target != value) {
+        target = value;
+        return true;
+    }
+    return false;
+}
+
+static bool sameAppProfiles(
+    const std::unordered_map<std::wstring, AppProfilePtr>& a,
+    const std::unordered_map<std::wstring, AppProfilePtr>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
     }
-    return *monitorOptions[id];
+    for (auto& it : a) {
+        auto other = b.find(it.first);
+        if (other == b.end() ||
+            other->second->opacity != it.second->opacity ||
+            other->second->temperature != it.second->temperature)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static ToneCurvePtr parseToneCurve(const json& j) {
+    static const char* channels[] = { "red", "green", "blue" };
+
+    auto curve = std::make_shared<ToneCurve>();
+    curve->gamma = j.value("gamma", 1.0f);
+    curve->contrast = j.value("contrast", 1.0f);
+    curve->blackLift = j.value("blackLift", 0.0f);
+
+    /* out of range values fall back to the defaults; the control points
+    are still honored. */
+    if (!curve->isValid()) {
+        const ToneCurve defaults;
+        curve->gamma = defaults.gamma;
+        curve->contrast = defaults.contrast;
+        curve->blackLift = defaults.blackLift;
+    }
+
+    for (int c = 0; c < 3; c++) {
+        auto points = j.find(channels[c]);
+        if (points != j.end() && points->is_array()) {
+            for (auto& point : *points) {
+                if (point.is_array() && point.size() == 2) {
+                    curve->points[c].push_back({ point[0].get<float>(), point[1].get<float>() });
+                }
+            }
+        }
+    }
+
+    return curve->isIdentity() ? ToneCurvePtr() : curve;
+}
+
+static json serializeToneCurve(const ToneCurve& curve) {
+    static const char* channels[] = { "red", "green", "blue" };
+
+    json j = {
+        { "gamma", curve.gamma },
+        { "contrast", curve.contrast },
+        { "blackLift", curve.blackLift }
+    };
+
+    for (int c = 0; c < 3; c++) {
+        if (!curve.points[c].empty()) {
+            json& points = j[channels[c]];
+            points = json::array();
+            for (auto& point : curve.points[c]) {
+                points.push_back({ point.x, point.y });
+            }
+        }
+    }
+
+    return j;
+}
+
+static bool sameToneCurve(const ToneCurvePtr& a, const ToneCurvePtr& b) {
+    return (!a || !b) ? (a == b) : (*a == *b);
+}
+
+static int64_t today() {
+    return (int64_t) time(nullptr) / 86400;
+}
+
+/* forgets monitors that haven't been connected for STALE_DAYS, in every
+profile. */
+static void pruneStaleMonitors() {
+    const int64_t cutoff = today() - STALE_DAYS;
+    for (auto it = lastSeen.begin(); it != lastSeen.end();) {
+        if (it->second < cutoff) {
+            for (auto& profile : profiles) {
+                profile.second.erase(it->first);
+            }
+            monitorStates.erase(it->first);
+            it = lastSeen.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+/* replaces the contents of target with the monitors in m. entries missing
+from m are dropped, and go back to defaults the next time they're used. */
+static bool applyMonitors(const json& m, OptionsMap& target) {
+    bool changed = false;
+    for (auto it = target.begin(); it != target.end();) {
+        if (m.find(u16to8(it->first)) == m.end()) {
+            it = target.erase(it);
+            changed = true;
+        }
+        else {
+            ++it;
+        }
+    }
+    for (auto it = m.begin(); it != m.end(); ++it) {
+        auto key = u8to16(it.key());
+        auto& value = it.value();
+        auto& options = target[key];
+        if (!options) {
+            options = std::make_shared<MonitorOptions>();
+            changed = true;
+        }
+        changed |= assign(options->opacity, value.value<float>("opacity", DEFAULT_OPACITY));
+        int temperature = value.value<int>("temperature", DEFAULT_TEMPERATURE);
+        if (!isValidTemperature(temperature)) {
+            temperature = DEFAULT_TEMPERATURE;
+        }
+        changed |= assign(options->temperature, temperature);
+        changed |= assign(options->enabled, value.value<bool>("enabled", true));
+        changed |= assign(options->backlight, value.value<int>("backlight", DEFAULT_BACKLIGHT));
+
+        /* keep the existing curve object if it's unchanged; overlays use
+        its identity to decide whether their ramp is still current. */
+        auto c = value.find("curve");
+        ToneCurvePtr curve = (c != value.end()) ? parseToneCurve(*c) : ToneCurvePtr();
+        if (!sameToneCurve(curve, options->curve)) {
+            options->curve = curve;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static json serializeMonitors(const OptionsMap& source) {
+    json m = json::object();
+    for (auto& it : source) {
+        json& monitor = m[u16to8(it.first)];
+        monitor = {
+            { "opacity", it.second->opacity },
+            { "temperature", it.second->temperature },
+            { "enabled", it.second->enabled },
+            { "backlight", it.second->backlight }
+        };
+        if (it.second->curve) {
+            monitor["curve"] = serializeToneCurve(*it.second->curve);
+        }
+    }
+    return m;
+}
+
+/* applies a serialized config on top of the current options. existing
+entries are updated in place, anything missing from the file goes back to
+its default, and the return value reports whether anything actually changed.
+throws if the config can't be parsed. */
+static bool applyConfig(const std::string& config) {
+    bool changed = false;
+    json j = json::parse(config);
+    const json empty = json::object();
+
+    auto m = j.find("monitors");
+    changed |= applyMonitors(m != j.end() ? *m : empty, profiles[DEFAULT_PROFILE]);
+
+    /* named profiles that were removed from the file go away too; otherwise
+    the next save would quietly bring them back. */
+    auto p = j.find("profiles");
+    std::set<std::string> names = { DEFAULT_PROFILE };
+    if (p != j.end()) {
+        for (auto it = (*p).begin(); it != (*p).end(); ++it) {
+            names.insert(it.key());
+            auto pm = it.value().find("monitors");
+            changed |= applyMonitors(
+                pm != it.value().end() ? *pm : empty, profiles[it.key()]);
+        }
+    }
+    for (auto it = profiles.begin(); it != profiles.end();) {
+        if (names.find(it->first) == names.end()) {
+            if (it->first == activeProfile) {
+                selectProfile(DEFAULT_PROFILE);
+            }
+            it = profiles.erase(it);
+            changed = true;
+        }
+        else {
+            ++it;
+        }
+    }
+
+    /* profiles are immutable once loaded; monitors that currently have one
+    applied keep their old copy until the next foreground change. */
+    std::unordered_map<std::wstring, AppProfilePtr> apps;
+    auto a = j.find("apps");
+    if (a != j.end()) {
+        for (auto it = (*a).begin(); it != (*a).end(); ++it) {
+            auto key = u8to16(it.key());
+            std::transform(key.begin(), key.end(), key.begin(), towlower);
+            auto profile = std::make_shared<AppProfile>();
+            profile->opacity = it.value().value<float>("opacity", -1.0f);
+            profile->temperature = it.value().value<int>("temperature", 0);
+            if (!isValidTemperature(profile->temperature)) {
+                profile->temperature = 0;
+            }
+            apps[key] = profile;
+        }
+    }
+    if (!sameAppProfiles(apps, appProfiles)) {
+        appProfiles.swap(apps);
+        changed = true;
+    }
+
+    auto found = j.find("general");
+    const json& g = (found != j.end()) ? *found : empty;
+    changed |= assign(pollingEnabled, g.value("pollingEnabled", false));
+    changed |= assign(globalEnabled, g.value("globalEnabled", true));
+    changed |= assign(adaptiveEnabled, g.value("adaptiveEnabled", false));
+    changed |= assign(ambientEnabled, g.value("ambientEnabled", false));
+    changed |= assign(idleTimeout,
+        std::min(maxIdleTimeout, std::max(0, g.value("idleTimeout", 0))));
+    changed |= assign(idleOpacity, g.value("idleOpacity", 0.7f));
+    FullscreenPolicy policy = FullscreenPolicy::Overlay;
+    parseFullscreenPolicyName(g.value("fullscreen", std::string()), policy);
+    changed |= assign(fullscreenPolicy, policy);
+    changed |= assign(panelDimmingEnabled, g.value("panelDimmingEnabled", false));
+    changed |= assign(focusFollowEnabled, g.value("focusFollowEnabled", false));
+    changed |= assign(unfocusedOpacity, g.value("unfocusedOpacity", 0.5f));
+
+    std::string profile = g.value("profile", std::string(DEFAULT_PROFILE));
+    if (profiles.find(profile) == profiles.end()) {
+        profile = DEFAULT_PROFILE;
+    }
+    changed |= selectProfile(profile);
+
+    /* bookkeeping only, so it never counts as a change. monitors without a
+    date (older configs, hand edits) start their clock now. */
+    auto seen = j.find("lastSeen");
+    if (seen != j.end()) {
+        for (auto it = (*seen).begin(); it != (*seen).end(); ++it) {
+            int64_t& day = lastSeen[u8to16(it.key())];
+            day = std::max(day, it.value().get<int64_t>());
+        }
+    }
+    for (auto& p : profiles) {
+        for (auto& o : p.second) {
+            if (lastSeen.find(o.first) == lastSeen.end()) {
+                lastSeen[o.first] = today();
+            }
+        }
+    }
+
+    return changed;
+}
+
+/* configured (or application profile) opacity with the adaptive, ambient,
+focus and idle adjustments applied */
+static float adjustedOpacity(const MonitorOptions& o, const MonitorState& s) {
+    float base = o.opacity;
+    if (s.appProfile && s.appProfile->opacity >= 0.0f) {
+        base = s.appProfile->opacity;
+    }
+    float opacity = std::min(1.0f, base * s.contentScale * ambientScale);
+    if (s.focusDim > 0.0f) {
+        /* focusDim fades between the configured level (0) and the
+        unfocused level (1); it never makes a monitor brighter. */
+        const float unfocused = std::max(opacity, unfocusedOpacity);
+        opacity += (unfocused - opacity) * s.focusDim;
+    }
+    if (idle) {
+        opacity = std::max(opacity, idleOpacity);
+    }
+    return opacity;
+}
+
+/* CIE 1976 lightness (0-1) of a relative luminance, and back. backlight
+levels are spaced roughly perceptually (so is the windows brightness
+slider), while opacity scales luminance; these convert between the two. */
+static float lightness(float luminance) {
+    return (luminance > 0.008856f)
+        ? 1.16f * std::cbrt(luminance) - 0.16f
+        : luminance * 9.033f;
+}
+
+static float luminance(float lightness) {
+    return (lightness > 0.08f)
+        ? std::pow((lightness + 0.16f) / 1.16f, 3.0f)
+        : lightness / 9.033f;
+}
+
+static bool usesPanel(const MonitorOptions& o, const MonitorState& s) {
+    return panelDimmingEnabled && globalEnabled && o.enabled && s.panelMinimum >= 0 &&
+        !(s.fullscreen && fullscreenPolicy == FullscreenPolicy::Suspend);
+}
+
+/* the panel level for `opacity`, rounded up so the panel never dims more
+than asked; the overlay makes up the difference. */
+static int panelLevel(float opacity, int minimum) {
+    const float level = lightness(1.0f - opacity) * 100.0f;
+    return std::max(minimum, std::min(100, (int) std::ceil(level - 0.001f)));
 }
 
 namespace dimmer {
     std::vector<Monitor> queryMonitors() {
+        metrics::Scope scope(metrics::QueryMonitors);
         std::vector<Monitor> result;
 
         EnumDisplayMonitors(
@@ -88,6 +548,11 @@ namespace dimmer {
             &MonitorEnumProc,
             reinterpret_cast<LPARAM>(&result));
 
+        const int64_t day = today();
+        for (auto& monitor : result) {
+            lastSeen[monitor.getId()] = day;
+        }
+
         return result;
     }
 
@@ -96,8 +561,313 @@ namespace dimmer {
     }
 
     void setMonitorOpacity(Monitor& monitor, float opacity) {
-        options(monitor).opacity = opacity;
+        auto& o = options(monitor);
+        if (o.opacity != opacity) {
+            o.opacity = opacity;
+            saveConfig();
+        }
+    }
+
+    float getEffectiveOpacity(Monitor& monitor) {
+        auto& s = state(monitor);
+        if (s.fullscreen && fullscreenPolicy == FullscreenPolicy::Suspend) {
+            return 0.0f;
+        }
+        auto& o = options(monitor);
+        float opacity = adjustedOpacity(o, s);
+        if (usesPanel(o, s)) {
+            /* same idea as the gamma policy below: the overlay only covers
+            what the panel can't, which is nothing above its lowest level. */
+            const float transmission = 1.0f - std::min(240.0f / 255.0f, opacity);
+            const int level = panelLevel(opacity, s.panelMinimum);
+            opacity = std::max(0.0f, 1.0f - transmission / luminance(level / 100.0f));
+            return (opacity < 0.5f / 255.0f) ? 0.0f : opacity;
+        }
+        if (s.fullscreen && fullscreenPolicy == FullscreenPolicy::Gamma && !s.gammaRejected) {
+            /* the overlay only covers what the ramp couldn't: the light
+            let through by both has to match the light let through by the
+            overlay alone. */
+            const float transmission = 1.0f - std::min(240.0f / 255.0f, opacity);
+            opacity = std::max(0.0f, 1.0f - transmission / getGammaBrightness(monitor));
+        }
+        return opacity;
+    }
+
+    float getGammaBrightness(Monitor& monitor) {
+        auto& s = state(monitor);
+        if (s.fullscreen && fullscreenPolicy == FullscreenPolicy::Gamma && !s.gammaRejected &&
+            !usesPanel(options(monitor), s))
+        {
+            /* rounded up to a whole step, so the ramp never dims more than
+            asked and the overlay makes up the difference. the small bias
+            keeps float noise from bumping exact steps up one. */
+            const float opacity = adjustedOpacity(options(monitor), s);
+            const float steps = (1.0f - opacity) * 100.0f / gammaBrightnessStep;
+            const int percent = (int) std::ceil(steps - 0.001f) * gammaBrightnessStep;
+            return std::max(minGammaBrightness, std::min(100, percent)) / 100.0f;
+        }
+        return 1.0f;
+    }
+
+    void setMonitorPanelMinimum(Monitor& monitor, int minimum) {
+        state(monitor).panelMinimum = std::max(-1, std::min(100, minimum));
+    }
+
+    int getPanelBrightness(Monitor& monitor) {
+        auto& o = options(monitor);
+        auto& s = state(monitor);
+        if (!usesPanel(o, s)) {
+            return -1;
+        }
+        return panelLevel(adjustedOpacity(o, s), s.panelMinimum);
+    }
+
+    int getEffectiveTemperature(Monitor& monitor) {
+        auto& s = state(monitor);
+        if (s.fullscreen && fullscreenPolicy == FullscreenPolicy::Suspend) {
+            return -1;
+        }
+        if (s.appProfile && s.appProfile->temperature != 0) {
+            return s.appProfile->temperature;
+        }
+        return options(monitor).temperature;
+    }
+
+    bool isMonitorFullscreen(Monitor& monitor) {
+        return state(monitor).fullscreen;
+    }
+
+    void setMonitorFullscreen(Monitor& monitor, bool fullscreen) {
+        auto& s = state(monitor);
+        if (s.fullscreen != fullscreen) {
+            s.fullscreen = fullscreen;
+            s.gammaRejected = false; /* worth another try next time */
+        }
+    }
+
+    void setMonitorGammaRejected(Monitor& monitor) {
+        state(monitor).gammaRejected = true;
+    }
+
+    bool isMonitorGammaRampRejected(Monitor& monitor) {
+        return state(monitor).rampRejected;
+    }
+
+    void setMonitorGammaRampRejected(Monitor& monitor, bool rejected) {
+        state(monitor).rampRejected = rejected;
+    }
+
+    FullscreenPolicy getFullscreenPolicy() {
+        return fullscreenPolicy;
+    }
+
+    void setFullscreenPolicy(FullscreenPolicy policy) {
+        if (fullscreenPolicy != policy) {
+            fullscreenPolicy = policy;
+            saveConfig();
+        }
+    }
+
+    std::string getFullscreenPolicyName(FullscreenPolicy policy) {
+        return fullscreenPolicyNames[(int) policy];
+    }
+
+    bool parseFullscreenPolicyName(const std::string& name, FullscreenPolicy& policy) {
+        for (int i = 0; i < 3; i++) {
+            if (name == fullscreenPolicyNames[i]) {
+                policy = (FullscreenPolicy) i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    float getMonitorContentScale(Monitor& monitor) {
+        return state(monitor).contentScale;
+    }
+
+    void setMonitorContentScale(Monitor& monitor, float scale) {
+        state(monitor).contentScale = scale;
+    }
+
+    float getAmbientScale() {
+        return ambientScale;
+    }
+
+    void setAmbientScale(float scale) {
+        ambientScale = scale;
+    }
+
+    AppProfilePtr getMonitorAppProfile(Monitor& monitor) {
+        return state(monitor).appProfile;
+    }
+
+    void setMonitorAppProfile(Monitor& monitor, AppProfilePtr profile) {
+        state(monitor).appProfile = profile;
+    }
+
+    AppProfilePtr findAppProfile(const std::wstring& exe) {
+        auto it = appProfiles.find(exe);
+        return (it == appProfiles.end()) ? AppProfilePtr() : it->second;
+    }
+
+    bool hasAppProfiles() {
+        return !appProfiles.empty();
+    }
+
+    float getMonitorFocusDim(Monitor& monitor) {
+        return state(monitor).focusDim;
+    }
+
+    void setMonitorFocusDim(Monitor& monitor, float dim) {
+        state(monitor).focusDim = dim;
+    }
+
+    std::vector<std::string> getProfileNames() {
+        std::vector<std::string> result;
+        for (auto& it : profiles) {
+            result.push_back(it.first);
+        }
+        return result;
+    }
+
+    const std::string& getActiveProfile() {
+        return activeProfile;
+    }
+
+    bool setActiveProfile(const std::string& name) {
+        if (profiles.find(name) == profiles.end()) {
+            return false;
+        }
+        if (selectProfile(name)) {
+            saveConfig();
+        }
+        return true;
+    }
+
+    bool createProfile(const std::string& name) {
+        if (name.empty() || profiles.find(name) != profiles.end()) {
+            return false;
+        }
+
+        /* new profiles start out as a copy of the current one. inserting
+        into the std::map doesn't move the active profile's node, so
+        monitorOptions stays valid. */
+        OptionsMap& copy = profiles[name];
+        for (auto& o : *monitorOptions) {
+            copy[o.first] = std::make_shared<MonitorOptions>(*o.second);
+        }
+
         saveConfig();
+        return true;
+    }
+
+    std::vector<std::pair<ToneCurvePtr, int>> getProfileColorSettings() {
+        std::set<std::pair<ToneCurvePtr, int>> settings;
+        for (auto& p : profiles) {
+            for (auto& o : p.second) {
+                settings.insert(std::make_pair(o.second->curve, o.second->temperature));
+
+                /* application profiles can override any monitor's temperature */
+                for (auto& it : appProfiles) {
+                    if (it.second->temperature != 0) {
+                        settings.insert(std::make_pair(o.second->curve, it.second->temperature));
+                    }
+                }
+            }
+        }
+        return std::vector<std::pair<ToneCurvePtr, int>>(settings.begin(), settings.end());
+    }
+
+    bool isPanelDimmingEnabled() {
+        return panelDimmingEnabled;
+    }
+
+    void setPanelDimmingEnabled(bool enabled) {
+        if (panelDimmingEnabled != enabled) {
+            panelDimmingEnabled = enabled;
+            saveConfig();
+        }
+    }
+
+    bool isFocusFollowEnabled() {
+        return focusFollowEnabled;
+    }
+
+    void setFocusFollowEnabled(bool enabled) {
+        if (focusFollowEnabled != enabled) {
+            focusFollowEnabled = enabled;
+            saveConfig();
+        }
+    }
+
+    float getUnfocusedOpacity() {
+        return unfocusedOpacity;
+    }
+
+    void setUnfocusedOpacity(float opacity) {
+        if (unfocusedOpacity != opacity) {
+            unfocusedOpacity = opacity;
+            saveConfig();
+        }
+    }
+
+    bool isAdaptiveEnabled() {
+        return adaptiveEnabled;
+    }
+
+    void setAdaptiveEnabled(bool enabled) {
+        if (adaptiveEnabled != enabled) {
+            adaptiveEnabled = enabled;
+            saveConfig();
+        }
+    }
+
+    bool isAmbientEnabled() {
+        return ambientEnabled;
+    }
+
+    void setAmbientEnabled(bool enabled) {
+        if (ambientEnabled != enabled) {
+            ambientEnabled = enabled;
+            saveConfig();
+        }
+    }
+
+    int getIdleTimeout() {
+        return idleTimeout;
+    }
+
+    void setIdleTimeout(int seconds) {
+        seconds = std::min(maxIdleTimeout, std::max(0, seconds));
+        if (idleTimeout != seconds) {
+            idleTimeout = seconds;
+            saveConfig();
+        }
+    }
+
+    float getIdleOpacity() {
+        return idleOpacity;
+    }
+
+    void setIdleOpacity(float opacity) {
+        if (idleOpacity != opacity) {
+            idleOpacity = opacity;
+            saveConfig();
+        }
+    }
+
+    bool isIdle() {
+        return idle;
+    }
+
+    void setIdle(bool value) {
+        idle = value;
+    }
+
+    bool isValidTemperature(int temperature) {
+        return temperature == -1 ||
+            (temperature >= minTemperature && temperature <= maxTemperature);
     }
 
     int getMonitorTemperature(Monitor& monitor) {
@@ -105,8 +875,39 @@ namespace dimmer {
     }
 
     void setMonitorTemperature(Monitor& monitor, int temperature) {
-        options(monitor).temperature = temperature;
-        saveConfig();
+        auto& o = options(monitor);
+        if (o.temperature != temperature) {
+            o.temperature = temperature;
+            saveConfig();
+        }
+    }
+
+    int getMonitorBacklight(Monitor& monitor) {
+        return options(monitor).backlight;
+    }
+
+    void setMonitorBacklight(Monitor& monitor, int percent) {
+        auto& o = options(monitor);
+        if (o.backlight != percent) {
+            o.backlight = percent;
+            saveConfig();
+        }
+    }
+
+    ToneCurvePtr getMonitorToneCurve(Monitor& monitor) {
+        return options(monitor).curve;
+    }
+
+    void setMonitorToneCurve(Monitor& monitor, ToneCurvePtr curve) {
+        if (curve && curve->isIdentity()) {
+            curve.reset();
+        }
+
+        auto& o = options(monitor);
+        if (!sameToneCurve(o.curve, curve)) {
+            o.curve = curve;
+            saveConfig();
+        }
     }
 
     bool isPollingEnabled() {
@@ -114,8 +915,10 @@ namespace dimmer {
     }
 
     void setPollingEnabled(bool enabled) {
-        pollingEnabled = enabled;
-        saveConfig();
+        if (pollingEnabled != enabled) {
+            pollingEnabled = enabled;
+            saveConfig();
+        }
     }
 
     extern bool isDimmerEnabled() {
@@ -134,56 +937,134 @@ namespace dimmer {
     }
 
     void setMonitorEnabled(Monitor& monitor, bool enabled) {
-        options(monitor).enabled = enabled;
-        saveConfig();
+        auto& o = options(monitor);
+        if (o.enabled != enabled) {
+            o.enabled = enabled;
+            saveConfig();
+        }
     }
 
     void loadConfig() {
+        metrics::Scope scope(metrics::LoadConfig);
         std::string config = fileToString(getConfigFilename());
         try {
-            json j = json::parse(config);
-            auto m = j.find("monitors");
-            if (m != j.end()) {
-                for (auto it = (*m).begin(); it != (*m).end(); ++it) {
-                    auto key = u8to16(it.key());
-                    auto value = it.value();
-                    auto options = std::make_shared<MonitorOptions>();
-                    options->opacity = value.value<float>("opacity", DEFAULT_OPACITY);
-                    options->temperature = value.value<int>("temperature", DEFAULT_TEMPERATURE);
-                    options->enabled = value.value<bool>("enabled", true);
-                    monitorOptions[key] = options;
-                }
-            }
+            applyConfig(config);
+            lastConfig = config;
+        }
+        catch (...) {
+            /* move on... */
+        }
+    }
 
-            auto g = j.find("general");
-            if (g != j.end()) {
-                pollingEnabled = (*g).value("pollingEnabled", false);
-                globalEnabled = (*g).value("globalEnabled", true);
+    bool reloadConfig() {
+        metrics::Scope scope(metrics::ReloadConfig);
+        std::string config = fileToString(getConfigFilename());
+        if (config == lastConfig) {
+            return false; /* our own write, or a no-op touch */
+        }
+
+        {
+            /* an older write of ours that landed after a newer one was
+            queued; the newer one is on its way. */
+            std::unique_lock<std::mutex> lock(writerMutex);
+            if (config == writtenConfig && writtenGeneration != queuedGeneration) {
+                return false;
             }
         }
+
+        try {
+            bool changed = applyConfig(config);
+            lastConfig = config;
+            return changed;
+        }
         catch (...) {
-            /* move on... */
+            /* probably caught mid-write; the next change notification will
+            bring us back here with the complete file. */
+            return false;
+        }
+    }
+
+    ConfigBatch::ConfigBatch() {
+        ++batchDepth;
+    }
+
+    ConfigBatch::~ConfigBatch() {
+        if (--batchDepth == 0 && batchDirty) {
+            batchDirty = false;
+            saveConfig();
         }
     }
 
     void saveConfig() {
-        json j = { { "monitors", { } } };
-        json& m = j["monitors"];
+        if (batchDepth > 0) {
+            batchDirty = true;
+            return;
+        }
+
+        metrics::Scope scope(metrics::SaveConfig);
+        json j;
 
-        auto monitors = queryMonitors();
-        for (auto monitor : monitors) {
-            m[u16to8(monitor.getId())] = {
-                { "opacity", getMonitorOpacity(monitor) },
-                { "temperature", getMonitorTemperature(monitor) },
-                { "enabled", isMonitorEnabled(monitor) }
-            };
+        pruneStaleMonitors();
+
+        /* serialize straight from the options store rather than enumerating
+        displays. this also keeps settings for monitors that are currently
+        disconnected. */
+        j["monitors"] = serializeMonitors(profiles[DEFAULT_PROFILE]);
+
+        json& p = j["profiles"];
+        p = json::object();
+        for (auto& it : profiles) {
+            if (it.first != DEFAULT_PROFILE) {
+                p[it.first] = { { "monitors", serializeMonitors(it.second) } };
+            }
+        }
+
+        json& a = j["apps"];
+        a = json::object();
+        for (auto& it : appProfiles) {
+            json& profile = a[u16to8(it.first)];
+            profile = json::object();
+            if (it.second->opacity >= 0.0f) {
+                profile["opacity"] = it.second->opacity;
+            }
+            if (it.second->temperature != 0) {
+                profile["temperature"] = it.second->temperature;
+            }
+        }
+
+        json& seen = j["lastSeen"];
+        seen = json::object();
+        for (auto& it : lastSeen) {
+            seen[u16to8(it.first)] = it.second;
         }
 
         j["general"] = {
             { "globalEnabled", globalEnabled },
-            { "pollingEnabled", pollingEnabled }
+            { "pollingEnabled", pollingEnabled },
+            { "adaptiveEnabled", adaptiveEnabled },
+            { "ambientEnabled", ambientEnabled },
+            { "idleTimeout", idleTimeout },
+            { "idleOpacity", idleOpacity },
+            { "fullscreen", fullscreenPolicyNames[(int) fullscreenPolicy] },
+            { "panelDimmingEnabled", panelDimmingEnabled },
+            { "focusFollowEnabled", focusFollowEnabled },
+            { "unfocusedOpacity", unfocusedOpacity },
+            { "profile", activeProfile }
         };
 
-        stringToFile(getConfigFilename(), j.dump(2));
+        lastConfig = j.dump(2);
+        queueConfigWrite(std::string(lastConfig));
+    }
+
+    void flushConfig() {
+        {
+            std::unique_lock<std::mutex> lock(writerMutex);
+            writerRunning = false;
+            writerCondition.notify_one();
+        }
+
+        if (writerThread.joinable()) {
+            writerThread.join();
+        }
     }
 }
\ No newline at end of file
@@ -37,8 +37,30 @@
 #include <Windows.h>
 #include <vector>
 #include <string>
+#include <memory>
+#include "ToneCurve.h"
 
 namespace dimmer {
+    /* what happens to a monitor's dimming while a fullscreen window is in
+    the foreground on it: keep the overlay, fold brightness into the gamma
+    ramp so the compositor doesn't have to blend an overlay every frame, or
+    suspend dimming (and temperature) entirely. */
+    enum class FullscreenPolicy : int {
+        Overlay = 0,
+        Gamma = 1,
+        Suspend = 2
+    };
+
+    /* overrides applied to a monitor while a given application is in the
+    foreground on it. a negative opacity or a zero temperature leaves the
+    monitor's own setting alone. */
+    struct AppProfile {
+        float opacity;
+        int temperature;
+    };
+
+    using AppProfilePtr = std::shared_ptr<const AppProfile>;
+
     struct Monitor {
         Monitor(HMONITOR handle, int index) {
             this->handle = handle;
@@ -46,10 +68,12 @@ namespace dimmer {
             this->info = {};
             this->info.cbSize = sizeof(MONITORINFOEX);
             GetMonitorInfo(handle, &this->info);
+            this->id = std::wstring(this->info.szDevice) + L"-" + std::to_wstring(index);
         }
 
-        std::wstring getId() const {
-            return std::wstring(this->info.szDevice) + L"-" + std::to_wstring(index);
+        /* computed once; this is the key for every options lookup. */
+        const std::wstring& getId() const {
+            return this->id;
         }
 
         std::wstring getName() const {
@@ -64,19 +88,123 @@ namespace dimmer {
         int index;
         HMONITOR handle;
         MONITORINFOEX info;
+        std::wstring id;
     };
 
     extern std::vector<Monitor> queryMonitors();
     extern float getMonitorOpacity(Monitor& monitor);
     extern void setMonitorOpacity(Monitor& monitor, float opacity);
+    /* the configured opacity with transient (unsaved) adjustments applied;
+    this is what the overlay actually displays. */
+    extern float getEffectiveOpacity(Monitor& monitor);
+    /* GDI rejects ramps that stray too far from identity unless the
+    GdiIcmGammaRange registry value is raised, so the gamma fullscreen policy
+    dims to no less than minGammaBrightness percent and leaves anything
+    darker to the overlay. brightness moves in gammaBrightnessStep steps so
+    every ramp it can ask for is built ahead of time. */
+    constexpr int minGammaBrightness = 50;
+    constexpr int gammaBrightnessStep = 5;
+    extern float getGammaBrightness(Monitor& monitor);
+    extern int getEffectiveTemperature(Monitor& monitor);
+    extern bool isMonitorFullscreen(Monitor& monitor);
+    extern void setMonitorFullscreen(Monitor& monitor, bool fullscreen);
+    /* called when the device refuses the dimmed ramp from
+    getGammaBrightness(); dimming goes back to the overlay until the monitor
+    leaves fullscreen. */
+    extern void setMonitorGammaRejected(Monitor& monitor);
+    /* whether the device refused the last ramp submitted for the monitor,
+    for any reason. reported through the status segment. */
+    extern bool isMonitorGammaRampRejected(Monitor& monitor);
+    extern void setMonitorGammaRampRejected(Monitor& monitor, bool rejected);
+    /* with panel dimming on, a laptop panel whose backlight windows exposes
+    through WMI does the dimming itself: the opacity is mapped onto the
+    panel's brightness along a perceptual curve, and the overlay only covers
+    what's left below the panel's lowest level. `minimum` (0-100) comes from
+    the panel's worker; -1 means the monitor has no such panel. */
+    extern void setMonitorPanelMinimum(Monitor& monitor, int minimum);
+    /* the panel brightness (0-100) to request, or -1 to leave the panel at
+    the level it had before we touched it. */
+    extern int getPanelBrightness(Monitor& monitor);
+    extern float getMonitorContentScale(Monitor& monitor);
+    extern void setMonitorContentScale(Monitor& monitor, float scale);
+    /* the ambient light sensor's verdict on the room, as a scale on every
+    monitor's opacity (like the content scale). 1 without a sensor. */
+    extern float getAmbientScale();
+    extern void setAmbientScale(float scale);
+    extern AppProfilePtr getMonitorAppProfile(Monitor& monitor);
+    extern void setMonitorAppProfile(Monitor& monitor, AppProfilePtr profile);
+    extern float getMonitorFocusDim(Monitor& monitor);
+    extern void setMonitorFocusDim(Monitor& monitor, float dim);
+    /* color temperatures are kelvin in [minTemperature, maxTemperature], or
+    -1 for none. anything else is rejected wherever it comes in. */
+    constexpr int minTemperature = 1000;
+    constexpr int maxTemperature = 10000;
+    extern bool isValidTemperature(int temperature);
     extern int getMonitorTemperature(Monitor& monitor);
     extern void setMonitorTemperature(Monitor& monitor, int temperature);
+    /* hardware brightness (0-100) set over DDC/CI, or -1 to leave the
+    panel's own setting alone. */
+    extern int getMonitorBacklight(Monitor& monitor);
+    extern void setMonitorBacklight(Monitor& monitor, int percent);
+    /* null means no curve (identity); identity curves are stored as null. */
+    extern ToneCurvePtr getMonitorToneCurve(Monitor& monitor);
+    extern void setMonitorToneCurve(Monitor& monitor, ToneCurvePtr curve);
     extern bool isMonitorEnabled(Monitor& monitor);
     extern void setMonitorEnabled(Monitor& monitor, bool enabled);
     extern bool isPollingEnabled();
     extern void setPollingEnabled(bool enabled);
     extern bool isDimmerEnabled();
     extern void setDimmerEnabled(bool enabled);
+    extern bool isAdaptiveEnabled();
+    extern void setAdaptiveEnabled(bool enabled);
+    extern bool isAmbientEnabled();
+    extern void setAmbientEnabled(bool enabled);
+    /* `exe` is a lower case file name, e.g. L"mpv.exe" */
+    extern AppProfilePtr findAppProfile(const std::wstring& exe);
+    extern bool hasAppProfiles();
+    /* named sets of per-monitor options ("day", "night", ...). the setters
+    above always modify the active profile. */
+    extern std::vector<std::string> getProfileNames();
+    extern const std::string& getActiveProfile();
+    /* switches to the named profile. returns false, leaving the active
+    profile alone, if there's no profile with that name. */
+    extern bool setActiveProfile(const std::string& name);
+    /* adds a profile that starts out as a copy of the active one. returns
+    false if the name is empty or already taken. */
+    extern bool createProfile(const std::string& name);
+    /* every (curve, temperature) combination referenced by any profile, so
+    the ramps can be built before they're needed. */
+    extern std::vector<std::pair<ToneCurvePtr, int>> getProfileColorSettings();
+    extern bool isPanelDimmingEnabled();
+    extern void setPanelDimmingEnabled(bool enabled);
+    extern bool isFocusFollowEnabled();
+    extern void setFocusFollowEnabled(bool enabled);
+    extern float getUnfocusedOpacity();
+    extern void setUnfocusedOpacity(float opacity);
+    /* seconds without input before dimming to the idle opacity, 0 to
+    disable. longer timeouts are clamped, which keeps the millisecond
+    timer math well inside 32 bits. */
+    constexpr int maxIdleTimeout = 86400;
+    extern int getIdleTimeout();
+    extern void setIdleTimeout(int seconds);
+    extern float getIdleOpacity();
+    extern void setIdleOpacity(float opacity);
+    extern bool isIdle();
+    extern void setIdle(bool idle);
+    extern FullscreenPolicy getFullscreenPolicy();
+    extern void setFullscreenPolicy(FullscreenPolicy policy);
+    extern std::string getFullscreenPolicyName(FullscreenPolicy policy);
+    extern bool parseFullscreenPolicyName(const std::string& name, FullscreenPolicy& policy);
     extern void loadConfig();
+    extern bool reloadConfig();
     extern void saveConfig();
+    extern void flushConfig();
+
+    /* defers saveConfig() until the outermost batch goes out of scope, so a
+    change applied to many monitors is serialized once instead of once per
+    monitor. */
+    struct ConfigBatch {
+        ConfigBatch();
+        ~ConfigBatch();
+    };
 }
\ No newline at end of file
@@ -34,12 +34,22 @@
 
 #include "Overlay.h"
 #include "Monitor.h"
+#include "Metrics.h"
+#include "Backlight.h"
+#include "Util.h"
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <cmath>
 #include <map>
+#include <set>
 
 using namespace dimmer;
 
-#define TIMER_ID 0xdeadbeef
+/* gamma state of a device we haven't written to yet. */
+#define TEMPERATURE_UNKNOWN 0
+#define RAMP_HASH_UNKNOWN 0
 
 constexpr int timerTickMs = 10;
 constexpr wchar_t className[] = L"DimmerOverlayClass";
@@ -47,7 +57,10 @@ constexpr wchar_t windowTitle[] = L"DimmerOverlayWindow";
 
 static ATOM overlayClass = 0;
 static std::map<HWND, Overlay*> hwndToOverlay;
-static WORD gammaRamp[3][256];
+static std::set<Overlay*> pollingOverlays;
+static UINT_PTR pollingTimerId = 0;
+static HWINEVENTHOOK popupHook = nullptr;
+static std::set<HWND> visiblePopups;
 
 static void registerClass(HINSTANCE instance, WNDPROC wndProc) {
     if (!overlayClass) {
@@ -55,6 +68,9 @@ static void registerClass(HINSTANCE instance, WNDPROC wndProc) {
         wc.lpfnWndProc = wndProc;
         wc.hInstance = instance;
         wc.lpszClassName = className;
+        /* one stock brush shared by every overlay instead of a GDI object
+        per monitor. stock objects are never freed. */
+        wc.hbrBackground = (HBRUSH) GetStockObject(BLACK_BRUSH);
         overlayClass = RegisterClass(&wc);
     }
 }
@@ -66,93 +82,236 @@ static bool enabled(Monitor& monitor) {
 Overlay::Overlay(HINSTANCE instance, Monitor monitor)
 : instance(instance)
 , monitor(monitor)
-, timerId(0)
-, bgBrush(CreateSolidBrush(RGB(0, 0, 0)))
-, hwnd(nullptr) {
+, hwnd(nullptr)
+, dc(nullptr)
+, opacity(-1)
+, temperature(TEMPERATURE_UNKNOWN)
+, brightness(100)
+, rejectedTemperature(TEMPERATURE_UNKNOWN)
+, rejectedBrightness(0)
+, hasBaseline(false)
+, hasApplied(false)
+, appliedHash(RAMP_HASH_UNKNOWN)
+, rect({}) {
     registerClass(instance, &Overlay::windowProc);
+    this->readBaseline();
     this->update(monitor);
 }
 
 Overlay::~Overlay() {
+    backlight::setPanel(this->monitor, -1);
     this->disableColorTemperature();
     this->disableBrigthnessOverlay();
-    DeleteObject(this->bgBrush);
+    this->releaseDeviceContext();
 }
 
-static void colorTemperatureToRgb(int kelvin, float& red, float& green, float& blue) {
-    kelvin /= 100;
+HDC Overlay::deviceContext() {
+    /* creating a display DC is expensive, so we keep one around for the
+    lifetime of the overlay and reuse it for every ramp we submit. */
+    if (!this->dc) {
+        metrics::Scope scope(metrics::CreateDeviceContext);
+        this->dc = CreateDC(nullptr, monitor.info.szDevice, nullptr, nullptr);
+    }
+    return this->dc;
+}
 
-    if (kelvin <= 66) {
-        red = 255;
+void Overlay::releaseDeviceContext() {
+    if (this->dc) {
+        DeleteDC(this->dc);
+        this->dc = nullptr;
     }
-    else {
-        red = kelvin - 60.0f;
-        red = (float)(329.698727446 * (pow(red, -0.1332047592)));
-        red = std::max(0.0f, std::min(255.0f, red));
+}
+
+/* settings are validated where they come in, so this is only a backstop: a
+value outside the range colorTemperatureToRgb() is meaningful for means no
+adjustment, never the nearest bound (a stray 0 must not turn into 1000K). */
+static int validTemperature(int temperature) {
+    return isValidTemperature(temperature) ? temperature : -1;
+}
+
+void Overlay::prepareGammaRamps(const std::vector<std::pair<ToneCurvePtr, int>>& settings) {
+    std::vector<std::pair<ToneCurvePtr, int>> valid;
+    for (auto& setting : settings) {
+        valid.push_back(std::make_pair(setting.first, validTemperature(setting.second)));
     }
 
-    if (kelvin <= 66) {
-        green = (float) kelvin;
-        green = 99.4708025861f * log(green) - 161.1195681661f;
-        green = std::max(0.0f, std::min(255.0f, green));
+    std::vector<int> brightness = { 100 };
+    if (getFullscreenPolicy() == FullscreenPolicy::Gamma) {
+        for (int b = minGammaBrightness; b < 100; b += gammaBrightnessStep) {
+            brightness.push_back(b);
+        }
     }
-    else {
-        green = kelvin - 60.0f;
-        green = (float)(288.1221695283 * (pow(green, -0.0755148492)));
-        green = std::max(0.0f, std::min(255.0f, green));
+
+    dimmer::prepareGammaRamps(valid, brightness);
+}
+
+/* hash of what the device reports after our ramp was submitted. drivers
+may quantize ramps (to 10 bits, say), so comparing against what we
+submitted would report drift forever on those. if the read back fails
+there's nothing to compare against later, so verification is skipped. */
+static uint64_t readBackHash(HDC dc) {
+    GammaRamp current;
+    if (GetDeviceGammaRamp(dc, &current.values[0][0])) {
+        return hashRamp(current);
     }
+    return RAMP_HASH_UNKNOWN;
+}
 
-    if (kelvin >= 66) {
-        blue = 255.0f;
+/* the contents of the display's ICC profile, or an empty string if it has
+none we can read. */
+static std::string readProfile(HDC dc) {
+    wchar_t path[MAX_PATH];
+    DWORD size = MAX_PATH;
+    if (!GetICMProfile(dc, &size, path)) {
+        return std::string();
     }
-    else {
-        blue = kelvin - 10.0f;
-        blue = 138.5177312231f * log(blue) - 305.0447927307f;
-        blue = std::max(0.0f, std::min(255.0f, blue));
+    return fileToString(path);
+}
+
+/* remembers the display's calibration, so ours can be layered on top of it
+and it can be restored exactly. called at startup and after mode changes;
+updateBaseline() decides where it comes from. */
+void Overlay::readBaseline() {
+    HDC dc = this->deviceContext();
+
+    GammaRamp current;
+    const bool readBack = dc && GetDeviceGammaRamp(dc, &current.values[0][0]);
+
+    /* if the ramp we applied survived the mode change, it's still there */
+    const bool ours = readBack && this->hasApplied && hashRamp(current) == this->appliedHash;
+    if (!ours) {
+        this->hasApplied = false;
     }
 
-    red /= 255.0f;
-    green /= 255.0f;
-    blue /= 255.0f;
+    updateBaseline(
+        dc ? readProfile(dc) : std::string(),
+        readBack ? &current : nullptr,
+        ours || (readBack && isCachedRamp(current)),
+        this->baseline,
+        this->hasBaseline);
 }
 
-void Overlay::disableColorTemperature() {
-    HDC dc = CreateDC(nullptr, monitor.info.szDevice, nullptr, nullptr);
+bool Overlay::applyGammaRamp(const ToneCurvePtr& curve, int temperature, int brightness) {
+    if (curve == this->rejectedCurve &&
+        temperature == this->rejectedTemperature &&
+        brightness == this->rejectedBrightness)
+    {
+        return false;
+    }
+
+    HDC dc = this->deviceContext();
     if (dc) {
-        for (int i = 0; i < 256; i++) {
-            gammaRamp[0][i] = gammaRamp[1][i] = gammaRamp[2][i] = i * 256;
+        metrics::Scope scope(metrics::ApplyGammaRamp);
+
+        GammaRamp composed;
+        if (!curve && temperature == -1 && brightness == 100) {
+            composed = this->baseline; /* exact restore, no rounding */
+        }
+        else {
+            composeRamp(this->baseline, getGammaRamp(curve, temperature, brightness), composed);
         }
-        SetDeviceGammaRamp(dc, gammaRamp);
-        DeleteDC(dc);
+
+        if (SetDeviceGammaRamp(dc, &composed.values[0][0])) {
+            this->applied = composed;
+            this->appliedHash = readBackHash(dc);
+            this->hasApplied = true;
+            this->curve = curve;
+            this->temperature = temperature;
+            this->brightness = brightness;
+            setMonitorGammaRampRejected(this->monitor, false);
+            return true;
+        }
+
+        /* GDI refuses ramps that stray too far from identity (warmer than
+        about 4500K, or steep curves) unless the GdiIcmGammaRange registry
+        value is raised. the refusal shows up in the metrics and the status
+        segment rather than being retried forever. */
+        metrics::record(metrics::RejectGammaRamp, 0);
+        this->rejectedCurve = curve;
+        this->rejectedTemperature = temperature;
+        this->rejectedBrightness = brightness;
+        setMonitorGammaRampRejected(this->monitor, true);
+    }
+    return false;
+}
+
+bool Overlay::verifyGammaRamp() {
+    if (!this->hasApplied || this->appliedHash == RAMP_HASH_UNKNOWN) {
+        return false;
+    }
+
+    HDC dc = this->deviceContext();
+    if (!dc) {
+        return false;
+    }
+
+    metrics::Scope scope(metrics::VerifyGammaRamp);
+
+    GammaRamp current;
+    if (!GetDeviceGammaRamp(dc, &current.values[0][0]) ||
+        hashRamp(current) == this->appliedHash)
+    {
+        return false;
+    }
+
+    /* the composed ramp is still valid; no need to rebuild anything */
+    if (SetDeviceGammaRamp(dc, &this->applied.values[0][0])) {
+        this->appliedHash = readBackHash(dc);
+        return true;
+    }
+
+    /* the device won't take back a ramp it used to accept (the driver
+    changed, or GdiIcmGammaRange was lowered). that's a refusal like any
+    other: it's remembered and reported, and the update falls back to the
+    overlay for the dimming. there's nothing left to protect, so this monitor
+    no longer keeps the watch polling. */
+    metrics::record(metrics::RejectGammaRamp, 0);
+    this->rejectedCurve = this->curve;
+    this->rejectedTemperature = this->temperature;
+    this->rejectedBrightness = this->brightness;
+    this->hasApplied = false;
+    this->temperature = TEMPERATURE_UNKNOWN;
+    setMonitorGammaRampRejected(this->monitor, true);
+    this->update(this->monitor);
+    return false;
+}
+
+bool Overlay::hasGammaRamp() const {
+    return this->hasApplied &&
+        (this->curve || this->temperature != -1 || this->brightness != 100);
+}
+
+void Overlay::disableColorTemperature() {
+    if (this->curve || this->temperature != -1 || this->brightness != 100) {
+        this->applyGammaRamp(ToneCurvePtr(), -1, 100);
     }
 }
 
 void Overlay::updateColorTemperature() {
-    int temperature = getMonitorTemperature(monitor);
+    ToneCurvePtr curve = getMonitorToneCurve(monitor);
+    int temperature = getEffectiveTemperature(monitor);
+    int brightness = (int) round(getGammaBrightness(monitor) * 100.0f);
 
-    if (!enabled(monitor) || temperature == -1) {
+    if (!enabled(monitor) || (!curve && temperature == -1 && brightness == 100)) {
         disableColorTemperature();
     }
     else {
-        HDC dc = CreateDC(nullptr, monitor.info.szDevice, nullptr, nullptr);
-        if (dc) {
-            float red = 1.0f;
-            float green = 1.0f;
-            float blue = 1.0f;
-
-            temperature = std::min(6000, std::max(4500, temperature));
-            colorTemperatureToRgb(temperature, red, green, blue);
-
-            for (int i = 0; i < 256; i++) {
-                float brightness = i * (256.0f);
-                gammaRamp[0][i] = (short)std::max(0.0f, std::min(65535.0f, brightness * red));
-                gammaRamp[1][i] = (short)std::max(0.0f, std::min(65535.0f, brightness * green));
-                gammaRamp[2][i] = (short)std::max(0.0f, std::min(65535.0f, brightness * blue));
+        temperature = validTemperature(temperature);
+
+        /* SetDeviceGammaRamp() is a synchronous round trip to the driver;
+        don't resubmit a ramp the device already has. */
+        if (curve != this->curve ||
+            temperature != this->temperature ||
+            brightness != this->brightness)
+        {
+            /* a dimmed ramp the device refuses goes back to the overlay,
+            which updateBrightnessOverlay() picks up right after this. */
+            if (!this->applyGammaRamp(curve, temperature, brightness) && brightness != 100) {
+                setMonitorGammaRejected(monitor);
+                if (curve != this->curve || temperature != this->temperature || this->brightness != 100) {
+                    this->applyGammaRamp(curve, temperature, 100);
+                }
             }
-
-            SetDeviceGammaRamp(dc, gammaRamp);
-
-            DeleteDC(dc);
         }
     }
 }
@@ -163,11 +322,35 @@ void Overlay::disableBrigthnessOverlay() {
         DestroyWindow(this->hwnd);
         hwndToOverlay.erase(hwndToOverlay.find(this->hwnd));
         this->hwnd = nullptr;
+        this->opacity = -1;
+        this->rect = {};
+    }
+}
+
+/* the overlay never goes fully opaque, so the screen stays usable */
+static BYTE toAlpha(float opacity) {
+    opacity = std::min(1.0f, std::max(0.0f, opacity));
+    return std::min((BYTE) 240, (BYTE) (opacity * 255.0f));
+}
+
+void Overlay::updateOpacity() {
+    this->updatePanel();
+
+    if (!this->hwnd || !enabled(monitor) || getEffectiveOpacity(monitor) == 0.0f) {
+        this->updateBrightnessOverlay(); /* the window comes or goes */
+        return;
+    }
+
+    BYTE opacity = toAlpha(getEffectiveOpacity(this->monitor));
+    if (opacity != this->opacity) {
+        metrics::Scope scope(metrics::UpdateOverlayWindow);
+        SetLayeredWindowAttributes(this->hwnd, 0, opacity, LWA_ALPHA);
+        this->opacity = opacity;
     }
 }
 
 void Overlay::updateBrightnessOverlay() {
-    if (!enabled(monitor) || getMonitorOpacity(monitor) == 0.0f) {
+    if (!enabled(monitor) || getEffectiveOpacity(monitor) == 0.0f) {
         disableBrigthnessOverlay();
     }
     else {
@@ -189,47 +372,167 @@ void Overlay::updateBrightnessOverlay() {
             SetWindowLong(this->hwnd, GWL_STYLE, 0); /* removes title, borders. */
         }
 
-        float red, green, blue;
-        colorTemperatureToRgb(3000, red, green, blue);
-        red = (1.0f - red) * 256.0f;
-        green = (1.0f - green) * 256.0f;
-        blue = (1.0f - blue) * 256.0f;
+        const RECT& rect = monitor.info.rcMonitor;
 
-        int x = monitor.info.rcMonitor.left;
-        int y = monitor.info.rcMonitor.top;
-        int width = monitor.info.rcMonitor.right - x;
-        int height = monitor.info.rcMonitor.bottom - y;
+        BYTE opacity = toAlpha(getEffectiveOpacity(this->monitor));
 
-        float value = getMonitorOpacity(this->monitor);
-        value = std::min(1.0f, std::max(0.0f, value));
-        BYTE opacity = std::min((BYTE)240, (BYTE)(value * 255.0f));
-
-        SetLayeredWindowAttributes(this->hwnd, 0, opacity, LWA_ALPHA);
-        SetWindowPos(this->hwnd, HWND_TOPMOST, x, y, width, height, SWP_FRAMECHANGED | SWP_SHOWWINDOW);
+        /* the window is a solid fill, so there's nothing to redraw unless the
+        alpha or the monitor bounds actually changed. skipping these calls
+        avoids a full recomposite of the overlay on every menu interaction. */
+        if (opacity != this->opacity) {
+            metrics::Scope scope(metrics::UpdateOverlayWindow);
+            SetLayeredWindowAttributes(this->hwnd, 0, opacity, LWA_ALPHA);
+            this->opacity = opacity;
+        }
 
-        UpdateWindow(this->hwnd);
+        if (!EqualRect(&rect, &this->rect)) {
+            metrics::Scope scope(metrics::UpdateOverlayWindow);
+            SetWindowPos(
+                this->hwnd,
+                HWND_TOPMOST,
+                rect.left,
+                rect.top,
+                rect.right - rect.left,
+                rect.bottom - rect.top,
+                SWP_FRAMECHANGED | SWP_SHOWWINDOW);
+
+            UpdateWindow(this->hwnd);
+            this->rect = rect;
+        }
+        else {
+            /* another topmost window may have been raised above ours since
+            the last update. restoring the z-order without moving, sizing
+            or framing the window doesn't cost a recomposite. */
+            SetWindowPos(
+                this->hwnd,
+                HWND_TOPMOST,
+                0, 0, 0, 0,
+                SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
+        }
 
         this->startTimer();
     }
 }
 
 void Overlay::update(Monitor& monitor) {
+    metrics::Scope scope(metrics::UpdateOverlay);
+
+    /* mode changes reset the device's ramp behind our back, and may leave
+    our cached DC describing the old mode. */
+    if (!EqualRect(&monitor.info.rcMonitor, &this->monitor.info.rcMonitor)) {
+        this->temperature = TEMPERATURE_UNKNOWN;
+        this->brightness = 100;
+        this->curve.reset();
+        this->rejectedCurve.reset();
+        this->rejectedTemperature = TEMPERATURE_UNKNOWN;
+        this->releaseDeviceContext();
+        this->monitor = monitor;
+        this->readBaseline();
+    }
+
     this->monitor = monitor;
+    this->updatePanel();
     this->updateColorTemperature();
     this->updateBrightnessOverlay();
+
+    /* only posts a target; the DDC/CI write happens on a worker thread. */
+    const int percent = getMonitorBacklight(this->monitor);
+    if (enabled(this->monitor) && percent >= 0) {
+        backlight::set(this->monitor, percent);
+    }
 }
 
+/* hands the dimming to the laptop panel, if there is one. until its worker
+has found it, the overlay does all the dimming; the PanelWatch callback
+then brings us back here. */
+void Overlay::updatePanel() {
+    if (!isPanelDimmingEnabled()) {
+        setMonitorPanelMinimum(this->monitor, -1);
+        backlight::setPanel(this->monitor, -1);
+        return;
+    }
+
+    setMonitorPanelMinimum(this->monitor, backlight::findPanel(this->monitor));
+    backlight::setPanel(this->monitor, getPanelBrightness(this->monitor));
+}
+
+/* "dim popups" keeps the overlays above menus, tooltips and other topmost
+windows that open over them. rather than re-raising the overlays on every
+tick forever, a window event hook tells us when a topmost window is shown,
+and the shared 10ms timer only runs while at least one of them is still
+visible (some re-raise themselves while they're open). */
 void Overlay::startTimer() {
     this->killTimer();
 
-    if (isPollingEnabled()) {
-        this->timerId = SetTimer(this->hwnd, TIMER_ID, timerTickMs, nullptr);
+    if (isPollingEnabled() && this->hwnd) {
+        pollingOverlays.insert(this);
+        if (!popupHook) {
+            popupHook = SetWinEventHook(
+                EVENT_OBJECT_DESTROY, EVENT_OBJECT_HIDE,
+                nullptr, &Overlay::popupEventProc, 0, 0,
+                WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+        }
     }
 }
 
 void Overlay::killTimer() {
-    KillTimer(this->hwnd, this->timerId);
-    this->timerId = 0;
+    pollingOverlays.erase(this);
+    if (pollingOverlays.empty()) {
+        if (popupHook) {
+            UnhookWinEvent(popupHook);
+            popupHook = nullptr;
+        }
+        visiblePopups.clear();
+        if (pollingTimerId) {
+            KillTimer(nullptr, pollingTimerId);
+            pollingTimerId = 0;
+        }
+    }
+}
+
+void CALLBACK Overlay::popupEventProc(
+    HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject,
+    LONG idChild, DWORD thread, DWORD time)
+{
+    if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF ||
+        !hwnd || GetAncestor(hwnd, GA_ROOT) != hwnd)
+    {
+        return;
+    }
+
+    if (event == EVENT_OBJECT_SHOW) {
+        if (!(GetWindowLong(hwnd, GWL_EXSTYLE) & WS_EX_TOPMOST)) {
+            return;
+        }
+        visiblePopups.insert(hwnd);
+        for (auto overlay : pollingOverlays) {
+            BringWindowToTop(overlay->hwnd);
+        }
+        if (!pollingTimerId) {
+            pollingTimerId = SetTimer(nullptr, 0, timerTickMs, &Overlay::timerProc);
+        }
+    }
+    else {
+        visiblePopups.erase(hwnd);
+    }
+}
+
+void CALLBACK Overlay::timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    /* a hide can go unreported (the owner died, say), so visibility is
+    checked here too. */
+    for (auto it = visiblePopups.begin(); it != visiblePopups.end();) {
+        it = IsWindowVisible(*it) ? std::next(it) : visiblePopups.erase(it);
+    }
+
+    if (visiblePopups.empty()) {
+        KillTimer(nullptr, pollingTimerId);
+        pollingTimerId = 0;
+        return;
+    }
+
+    for (auto overlay : pollingOverlays) {
+        BringWindowToTop(overlay->hwnd);
+    }
 }
 
 LRESULT CALLBACK Overlay::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
@@ -238,19 +541,13 @@ LRESULT CALLBACK Overlay::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
     if (overlay != hwndToOverlay.end()) {
         switch (msg) {
             case WM_PAINT: {
+                /* the class background brush does the fill while erasing;
+                all that's left is to validate the region. */
                 PAINTSTRUCT ps;
-                HDC hdc = BeginPaint(hwnd, &ps);
-                FillRect(hdc, &ps.rcPaint, overlay->second->bgBrush);
+                BeginPaint(hwnd, &ps);
                 EndPaint(hwnd, &ps);
                 return 0;
             }
-
-            case WM_TIMER: {
-                if (wParam == overlay->second->timerId) {
-                    BringWindowToTop(hwnd);
-                    return 0;
-                }
-            }
         }
     }
 
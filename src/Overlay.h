@@ -35,6 +35,8 @@
 #pragma once
 
 #include <Windows.h>
+#include <cstdint>
+#include "GammaRamp.h"
 #include "Monitor.h"
 
 namespace dimmer {
@@ -44,21 +46,65 @@ namespace dimmer {
             ~Overlay();
 
             void update(Monitor& monitor);
+
+            /* only re-applies the overlay's opacity, for transient changes
+            (fades) that leave everything else alone. */
+            void updateOpacity();
             void startTimer();
             void killTimer();
 
+            /* reads back the device's ramp and re-applies ours if a driver
+            reset or mode switch replaced it. returns true if ours was
+            restored; if the device refuses it, the refusal is handled as in
+            update() and this returns false. */
+            bool verifyGammaRamp();
+
+            /* true if the device has one of our ramps (rather than just its
+            own calibration) applied. */
+            bool hasGammaRamp() const;
+
+            /* builds the ramps for the given curves and temperatures ahead
+            of time, including every dimmed step under the gamma fullscreen
+            policy, so switching profiles never computes one. ramps for
+            settings that are no longer in use are dropped. */
+            static void prepareGammaRamps(
+                const std::vector<std::pair<ToneCurvePtr, int>>& settings);
+
         private:
             static LRESULT CALLBACK windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+            static void CALLBACK timerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+            static void CALLBACK popupEventProc(
+                HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject,
+                LONG idChild, DWORD thread, DWORD time);
 
+            HDC deviceContext();
+            void releaseDeviceContext();
+            void readBaseline();
+            bool applyGammaRamp(const ToneCurvePtr& curve, int temperature, int brightness);
             void disableColorTemperature();
             void updateColorTemperature();
+            void updatePanel();
             void disableBrigthnessOverlay();
             void updateBrightnessOverlay();
 
             Monitor monitor;
             HINSTANCE instance;
-            HBRUSH bgBrush;
-            UINT_PTR timerId;
             HWND hwnd;
+            HDC dc;
+            int opacity;
+            int temperature;
+            int brightness;
+            ToneCurvePtr curve;
+            /* the last combination the device refused, so it isn't
+            resubmitted on every update. cleared by a mode change. */
+            ToneCurvePtr rejectedCurve;
+            int rejectedTemperature;
+            int rejectedBrightness;
+            GammaRamp baseline;
+            GammaRamp applied;
+            bool hasBaseline;
+            bool hasApplied;
+            uint64_t appliedHash;
+            RECT rect;
     };
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Status.h"
+#include "Monitor.h"
+#include "Util.h"
+#include <algorithm>
+
+using namespace dimmer;
+using namespace dimmer::status;
+
+static HANDLE mapping = nullptr;
+static Segment* segment = nullptr;
+
+static Segment* getSegment() {
+    if (!segment && !mapping) {
+        mapping = CreateFileMapping(
+            INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(Segment), segmentName);
+
+        if (mapping) {
+            segment = reinterpret_cast<Segment*>(
+                MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(Segment)));
+
+            if (segment) {
+                segment->version = segmentVersion;
+                segment->size = sizeof(Segment);
+            }
+        }
+    }
+    return segment;
+}
+
+static void copyString(char* dest, size_t size, const std::wstring& value) {
+    std::string utf8 = u16to8(value);
+    size_t count = std::min(size - 1, utf8.size());
+    memcpy(dest, utf8.c_str(), count);
+    dest[count] = '\0';
+}
+
+namespace dimmer {
+    void publishStatus(std::vector<Monitor>& monitors) {
+        Segment* s = getSegment();
+        if (!s) {
+            return;
+        }
+
+        uint32_t count = (uint32_t) std::min(monitors.size(), (size_t) maxMonitors);
+
+        status::write(s, [&](Segment& segment) {
+            segment.dimmerEnabled = isDimmerEnabled() ? 1 : 0;
+            segment.pollingEnabled = isPollingEnabled() ? 1 : 0;
+            segment.monitorCount = count;
+
+            for (uint32_t i = 0; i < count; i++) {
+                Monitor& monitor = monitors[i];
+                MonitorStatus& m = segment.monitors[i];
+                copyString(m.id, sizeof(m.id), monitor.getId());
+                copyString(m.name, sizeof(m.name), monitor.getName());
+                m.opacity = getMonitorOpacity(monitor);
+                m.temperature = getMonitorTemperature(monitor);
+                m.enabled = isMonitorEnabled(monitor) ? 1 : 0;
+                m.gammaRejected = isMonitorGammaRampRejected(monitor) ? 1 : 0;
+
+                const bool active = segment.dimmerEnabled && m.enabled;
+                m.effectiveOpacity = active ? getEffectiveOpacity(monitor) : 0.0f;
+                m.effectiveTemperature = active ? getEffectiveTemperature(monitor) : -1;
+            }
+        });
+    }
+}
@@ -0,0 +1,147 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* fixed-layout shared memory segment describing dimmer's current state,
+rewritten every time the overlays are updated. external readers (status
+bars, monitoring agents) can include this header on its own, map the
+segment once with status::open(), then take consistent snapshots with
+status::read() without any syscalls or locks. */
+
+namespace dimmer {
+    namespace status {
+        constexpr wchar_t segmentName[] = L"Local\\dimmer-status";
+        constexpr uint32_t segmentVersion = 2;
+        constexpr uint32_t maxMonitors = 256;
+
+        struct MonitorStatus {
+            char id[64];        /* utf8, nul-terminated, matches config.json */
+            char name[32];      /* utf8, nul-terminated, e.g. DISPLAY1 */
+            float opacity;      /* as configured */
+            int32_t temperature;  /* as configured, -1 for none */
+            uint32_t enabled;
+            uint32_t gammaRejected; /* the device refused the requested ramp */
+            /* what is on screen right now, after application profiles,
+            focus and idle dimming, and the fullscreen policy; 0 and -1 while
+            the monitor or dimming as a whole is off. when the backlight or
+            a gamma ramp takes part of the dimming, the opacity is only the
+            overlay's remaining share. */
+            float effectiveOpacity;
+            int32_t effectiveTemperature;
+        };
+
+        struct Segment {
+            /* seqlock: odd while the writer is mid-update. */
+            std::atomic<uint32_t> sequence;
+            uint32_t version;
+            uint32_t size;
+            uint32_t dimmerEnabled;
+            uint32_t pollingEnabled;
+            uint32_t monitorCount;
+            uint32_t reserved[2];
+            MonitorStatus monitors[maxMonitors];
+        };
+
+        /* maps the segment read-only. returns nullptr if dimmer isn't running
+        or the layout doesn't match. release with UnmapViewOfFile(). */
+        inline const Segment* open() {
+            HANDLE mapping = OpenFileMapping(FILE_MAP_READ, FALSE, segmentName);
+            if (!mapping) {
+                return nullptr;
+            }
+
+            auto segment = reinterpret_cast<const Segment*>(
+                MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(Segment)));
+
+            CloseHandle(mapping); /* the view keeps the mapping alive */
+
+            if (segment && (segment->version != segmentVersion || segment->size != sizeof(Segment))) {
+                UnmapViewOfFile(segment);
+                return nullptr;
+            }
+
+            return segment;
+        }
+
+        /* seqlock write: bumps the sequence to odd, lets `update` modify the
+        segment in place, then bumps it back to even. readers that overlap the
+        update see a changed or odd sequence and retry. single writer only. */
+        template <typename Update>
+        inline void write(Segment* segment, Update&& update) {
+            uint32_t sequence = segment->sequence.load(std::memory_order_relaxed);
+            segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            update(*segment);
+
+            segment->sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        /* copies a consistent snapshot of `segment` into `result`, retrying
+        while the writer is active. `result.sequence` is not meaningful. */
+        inline void read(const Segment* segment, Segment& result) {
+            while (true) {
+                uint32_t before = segment->sequence.load(std::memory_order_acquire);
+                if (before & 1) {
+                    YieldProcessor();
+                    continue;
+                }
+
+                memcpy(
+                    reinterpret_cast<char*>(&result) + sizeof(result.sequence),
+                    reinterpret_cast<const char*>(segment) + sizeof(result.sequence),
+                    sizeof(Segment) - sizeof(result.sequence));
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (segment->sequence.load(std::memory_order_relaxed) == before) {
+                    return;
+                }
+            }
+        }
+    }
+
+    struct Monitor;
+
+    /* rewrites the segment from the current monitor state. dimmer only;
+    external readers never call this. */
+    extern void publishStatus(std::vector<Monitor>& monitors);
+}
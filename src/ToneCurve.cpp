@@ -0,0 +1,225 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ToneCurve.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace dimmer;
+
+ToneCurve::ToneCurve()
+: gamma(1.0f)
+, contrast(1.0f)
+, blackLift(0.0f) {
+}
+
+bool ToneCurve::isIdentity() const {
+    return gamma == 1.0f && contrast == 1.0f && blackLift == 0.0f &&
+        points[0].empty() && points[1].empty() && points[2].empty();
+}
+
+bool ToneCurve::isValid() const {
+    return std::isfinite(gamma) && gamma > 0.0f &&
+        std::isfinite(contrast) && contrast >= 0.0f &&
+        blackLift >= 0.0f && blackLift < 1.0f;
+}
+
+bool ToneCurve::operator==(const ToneCurve& other) const {
+    if (gamma != other.gamma || contrast != other.contrast || blackLift != other.blackLift) {
+        return false;
+    }
+    for (int c = 0; c < 3; c++) {
+        if (points[c].size() != other.points[c].size()) {
+            return false;
+        }
+        for (size_t i = 0; i < points[c].size(); i++) {
+            if (points[c][i].x != other.points[c][i].x || points[c][i].y != other.points[c][i].y) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* fills `out` with the curve through `points` sampled at i / 255, using
+fritsch-carlson monotone cubic interpolation: unlike a natural spline it
+never overshoots, so a monotone set of points always yields a monotone
+ramp. the curve is pinned to (0, 0) and (1, 1) unless points are given
+there. */
+static void interpolate(const std::vector<CurvePoint>& points, float out[256]) {
+    std::vector<CurvePoint> p(points);
+    std::sort(p.begin(), p.end(), [](const CurvePoint& a, const CurvePoint& b) {
+        return a.x < b.x;
+    });
+    p.erase(std::unique(p.begin(), p.end(), [](const CurvePoint& a, const CurvePoint& b) {
+        return a.x == b.x;
+    }), p.end());
+
+    if (p.empty() || p.front().x > 0.0f) {
+        p.insert(p.begin(), { 0.0f, 0.0f });
+    }
+    if (p.back().x < 1.0f) {
+        p.push_back({ 1.0f, 1.0f });
+    }
+
+    const size_t n = p.size();
+    std::vector<float> delta(n - 1), tangent(n);
+
+    for (size_t k = 0; k < n - 1; k++) {
+        delta[k] = (p[k + 1].y - p[k].y) / (p[k + 1].x - p[k].x);
+    }
+
+    tangent[0] = delta[0];
+    tangent[n - 1] = delta[n - 2];
+    for (size_t k = 1; k < n - 1; k++) {
+        tangent[k] = (delta[k - 1] * delta[k] <= 0.0f)
+            ? 0.0f : (delta[k - 1] + delta[k]) * 0.5f;
+    }
+
+    for (size_t k = 0; k < n - 1; k++) {
+        if (delta[k] == 0.0f) {
+            tangent[k] = tangent[k + 1] = 0.0f;
+        }
+        else {
+            const float a = tangent[k] / delta[k];
+            const float b = tangent[k + 1] / delta[k];
+            const float length = a * a + b * b;
+            if (length > 9.0f) {
+                const float t = 3.0f / sqrt(length);
+                tangent[k] = t * a * delta[k];
+                tangent[k + 1] = t * b * delta[k];
+            }
+        }
+    }
+
+    /* samples are increasing, so the segment only ever moves forward */
+    size_t k = 0;
+    for (int i = 0; i < 256; i++) {
+        const float x = (float) i / 255.0f;
+        if (x <= p.front().x) {
+            out[i] = p.front().y;
+            continue;
+        }
+        if (x >= p.back().x) {
+            out[i] = p.back().y;
+            continue;
+        }
+        while (x > p[k + 1].x) {
+            k++;
+        }
+
+        const float h = p[k + 1].x - p[k].x;
+        const float t = (x - p[k].x) / h;
+        const float t2 = t * t;
+        const float t3 = t2 * t;
+        out[i] =
+            (2.0f * t3 - 3.0f * t2 + 1.0f) * p[k].y +
+            (t3 - 2.0f * t2 + t) * h * tangent[k] +
+            (-2.0f * t3 + 3.0f * t2) * p[k + 1].y +
+            (t3 - t2) * h * tangent[k + 1];
+    }
+}
+
+namespace dimmer {
+    void colorTemperatureToRgb(int kelvin, float& red, float& green, float& blue) {
+        kelvin /= 100;
+
+        if (kelvin <= 66) {
+            red = 255;
+        }
+        else {
+            red = kelvin - 60.0f;
+            red = (float)(329.698727446 * (pow(red, -0.1332047592)));
+            red = std::max(0.0f, std::min(255.0f, red));
+        }
+
+        if (kelvin <= 66) {
+            green = (float) kelvin;
+            green = 99.4708025861f * log(green) - 161.1195681661f;
+            green = std::max(0.0f, std::min(255.0f, green));
+        }
+        else {
+            green = kelvin - 60.0f;
+            green = (float)(288.1221695283 * (pow(green, -0.0755148492)));
+            green = std::max(0.0f, std::min(255.0f, green));
+        }
+
+        if (kelvin >= 66) {
+            blue = 255.0f;
+        }
+        else if (kelvin <= 19) {
+            blue = 0.0f; /* log() below would go negative or undefined */
+        }
+        else {
+            blue = kelvin - 10.0f;
+            blue = 138.5177312231f * log(blue) - 305.0447927307f;
+            blue = std::max(0.0f, std::min(255.0f, blue));
+        }
+
+        red /= 255.0f;
+        green /= 255.0f;
+        blue /= 255.0f;
+    }
+
+    void compileToneCurve(const ToneCurve* curve, const float scale[3], WORD ramp[3][256]) {
+        float values[256];
+
+        for (int c = 0; c < 3; c++) {
+            if (curve && !curve->points[c].empty()) {
+                interpolate(curve->points[c], values);
+            }
+            else {
+                for (int i = 0; i < 256; i++) {
+                    values[i] = (float) i / 255.0f;
+                }
+            }
+
+            for (int i = 0; i < 256; i++) {
+                float y = values[i];
+
+                if (curve) {
+                    y = (y - 0.5f) * curve->contrast + 0.5f;
+                    y = std::max(0.0f, std::min(1.0f, y));
+                    if (curve->gamma > 0.0f && curve->gamma != 1.0f) {
+                        y = pow(y, 1.0f / curve->gamma);
+                    }
+                    y = curve->blackLift + (1.0f - curve->blackLift) * y;
+                }
+
+                y *= scale[c];
+                ramp[c][i] = (WORD) (std::max(0.0f, std::min(1.0f, y)) * 65535.0f + 0.5f);
+            }
+        }
+    }
+}
@@ -0,0 +1,79 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Windows.h>
+#include <memory>
+#include <vector>
+
+namespace dimmer {
+    struct CurvePoint {
+        float x;
+        float y;
+    };
+
+    /* a user-defined tone curve. the per-channel control points are
+    interpolated with a monotone cubic, then contrast (around mid grey),
+    gamma and black lift are applied to all three channels. curves are
+    immutable once created; edits produce a new one. */
+    struct ToneCurve {
+        ToneCurve();
+
+        bool isIdentity() const;
+        /* gamma > 0, contrast >= 0 and 0 <= blackLift < 1, all finite.
+        the config parser and the control pipe reject anything else. */
+        bool isValid() const;
+        bool operator==(const ToneCurve& other) const;
+        bool operator!=(const ToneCurve& other) const { return !(*this == other); }
+
+        float gamma;
+        float contrast;
+        float blackLift;
+        std::vector<CurvePoint> points[3]; /* red, green, blue */
+    };
+
+    using ToneCurvePtr = std::shared_ptr<const ToneCurve>;
+
+    /* the rgb multipliers (0-1) that approximate black body light at
+    `kelvin`, relative to 6600K. */
+    extern void colorTemperatureToRgb(int kelvin, float& red, float& green, float& blue);
+
+    /* evaluates `curve` (identity if null) for all 256 inputs of each
+    channel, multiplies the results by `scale` (temperature and brightness)
+    and writes them to `ramp` in 16 bit gamma ramp units. this is the only
+    place ramps are computed, so everything happens in this single pass. */
+    extern void compileToneCurve(
+        const ToneCurve* curve, const float scale[3], WORD ramp[3][256]);
+}
@@ -0,0 +1,245 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Trace.h"
+#include "Util.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace dimmer;
+
+/* per-thread capacity; once full, the oldest spans are overwritten. */
+constexpr uint64_t bufferCapacity = 16384;
+
+struct Event {
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+/* single producer (the owning thread). flush() reads whatever has been
+published so far; a span that's being overwritten while a flush is in
+progress may come out garbled, which only happens after wrapping. */
+struct Buffer {
+    DWORD threadId;
+    bool inUse; /* guarded by buffersMutex */
+    std::atomic<uint64_t> written;
+    Event events[bufferCapacity];
+};
+
+struct ThreadEvent {
+    DWORD threadId;
+    Event event;
+};
+
+using Snapshot = std::vector<ThreadEvent>;
+
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<Buffer>> buffers;
+static std::wstring traceFilename;
+
+/* buffers are ~400KB each, so a thread hands its buffer back when it exits
+and the next thread that starts tracing takes it over, rather than every
+short-lived thread leaving one behind. */
+struct BufferOwner {
+    Buffer* buffer = nullptr;
+
+    ~BufferOwner() {
+        if (this->buffer) {
+            std::unique_lock<std::mutex> lock(buffersMutex);
+            this->buffer->inUse = false;
+        }
+    }
+};
+
+static thread_local BufferOwner threadBuffer;
+
+static std::mutex writerMutex;
+static std::condition_variable writerCondition;
+static std::thread writerThread;
+static std::unique_ptr<Snapshot> pendingSnapshot;
+static bool writerRunning = false;
+
+/* a recycled buffer starts over empty: the spans of the thread that had it
+before are dropped at that point, rather than being attributed to the new
+owner. */
+static Buffer* getThreadBuffer() {
+    if (!threadBuffer.buffer) {
+        std::unique_lock<std::mutex> lock(buffersMutex);
+
+        for (auto& buffer : buffers) {
+            if (!buffer->inUse) {
+                threadBuffer.buffer = buffer.get();
+                break;
+            }
+        }
+
+        if (!threadBuffer.buffer) {
+            buffers.push_back(std::unique_ptr<Buffer>(new Buffer()));
+            threadBuffer.buffer = buffers.back().get();
+        }
+
+        Buffer* buffer = threadBuffer.buffer;
+        buffer->threadId = GetCurrentThreadId();
+        buffer->inUse = true;
+        buffer->written = 0;
+    }
+    return threadBuffer.buffer;
+}
+
+static std::string serialize(const Snapshot& snapshot) {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    const double ticksToMicros = 1000000.0 / (double) frequency.QuadPart;
+    const DWORD pid = GetCurrentProcessId();
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    char line[256];
+
+    for (auto& t : snapshot) {
+        const Event& e = t.event;
+        snprintf(
+            line,
+            sizeof(line),
+            "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu}",
+            first ? "" : ",",
+            e.name,
+            (double) e.start * ticksToMicros,
+            (double) (e.end - e.start) * ticksToMicros,
+            (unsigned long) pid,
+            (unsigned long) t.threadId);
+
+        json += line;
+        first = false;
+    }
+
+    json += "]}";
+    return json;
+}
+
+/* formats and writes snapshots off the ui thread. like the config writer,
+only the newest pending snapshot is kept. */
+static void writerProc() {
+    std::wstring filename;
+    {
+        std::unique_lock<std::mutex> lock(buffersMutex);
+        filename = traceFilename;
+    }
+
+    std::unique_lock<std::mutex> lock(writerMutex);
+    while (true) {
+        writerCondition.wait(lock, [] { return pendingSnapshot || !writerRunning; });
+        if (pendingSnapshot) {
+            std::unique_ptr<Snapshot> snapshot = std::move(pendingSnapshot);
+            lock.unlock();
+            stringToFile(filename, serialize(*snapshot));
+            lock.lock();
+        }
+        else {
+            break;
+        }
+    }
+}
+
+namespace dimmer {
+    namespace trace {
+        std::atomic<bool> enabled(false);
+
+        void start(const std::wstring& filename) {
+            {
+                std::unique_lock<std::mutex> lock(buffersMutex);
+                traceFilename = filename;
+            }
+            enabled = true;
+        }
+
+        void span(const char* name, int64_t startTicks, int64_t endTicks) {
+            Buffer* buffer = getThreadBuffer();
+            uint64_t index = buffer->written.load(std::memory_order_relaxed);
+            Event& e = buffer->events[index % bufferCapacity];
+            e.name = name;
+            e.start = startTicks;
+            e.end = endTicks;
+            buffer->written.store(index + 1, std::memory_order_release);
+        }
+
+        bool flush() {
+            if (!isEnabled()) {
+                return false;
+            }
+
+            /* only copy the raw spans while holding the lock; formatting
+            and disk i/o happen on the writer thread. */
+            std::unique_ptr<Snapshot> snapshot(new Snapshot());
+            {
+                std::unique_lock<std::mutex> lock(buffersMutex);
+                snapshot->reserve(buffers.size() * bufferCapacity);
+                for (auto& buffer : buffers) {
+                    uint64_t end = buffer->written.load(std::memory_order_acquire);
+                    uint64_t begin = (end > bufferCapacity) ? end - bufferCapacity : 0;
+                    for (uint64_t i = begin; i < end; i++) {
+                        snapshot->push_back({ buffer->threadId, buffer->events[i % bufferCapacity] });
+                    }
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(writerMutex);
+            pendingSnapshot = std::move(snapshot);
+            if (!writerRunning) {
+                writerRunning = true;
+                writerThread = std::thread(&writerProc);
+            }
+            writerCondition.notify_one();
+            return true;
+        }
+
+        void stop() {
+            flush();
+
+            {
+                std::unique_lock<std::mutex> lock(writerMutex);
+                writerRunning = false;
+                writerCondition.notify_one();
+            }
+
+            if (writerThread.joinable()) {
+                writerThread.join();
+            }
+        }
+    }
+}
@@ -34,11 +34,15 @@
 
 #include "TrayMenu.h"
 #include "Monitor.h"
+#include "Metrics.h"
+#include "Util.h"
 #include "resource.h"
 #include <Commdlg.h>
 #include <CommCtrl.h>
 #include <shellapi.h>
 #include <map>
+#include <vector>
+#include <climits>
 #include <memory>
 #include <algorithm>
 
@@ -48,10 +52,21 @@ using namespace dimmer;
 #define MENU_ID_EXIT 500
 #define MENU_ID_POLL 501
 #define MENU_ID_ENABLED 502
+#define MENU_ID_ADAPTIVE 503
+#define MENU_ID_FOCUS 504
+#define MENU_ID_PANEL 505
+#define MENU_ID_AMBIENT 506
+#define MENU_ID_PROFILE_BASE 510
+#define MENU_ID_ALL_BASE 600
 #define MENU_ID_MONITOR_BASE 1000
+#define MENU_ID_MONITOR_STRIDE 128
 #define MENU_ID_MONITOR_USER 100
 #define MENU_ID_MONITOR_COLOR 1
 
+/* per-monitor ids are MENU_ID_MONITOR_BASE + (index * MENU_ID_MONITOR_STRIDE)
++ value, where value is an opacity percentage or one of the MENU_ID_*K
+entries below. that leaves room for ~500 monitors below 0xffff. the "all
+monitors" group uses MENU_ID_ALL_BASE + value. */
 #define MENU_ID_DEFAULTK (MENU_ID_MONITOR_USER + 1)
 #define MENU_ID_4500K (MENU_ID_MONITOR_USER + 2)
 #define MENU_ID_5000K (MENU_ID_MONITOR_USER + 3)
@@ -67,6 +82,12 @@ static ATOM overlayClass = 0;
 static HICON trayIcon = nullptr;
 static HMENU menu = nullptr;
 static std::map<HWND, TrayMenu*> hwndToInstance;
+static std::vector<Monitor> menuMonitors;
+static std::vector<std::string> menuProfiles;
+static std::map<HMENU, size_t> unpopulatedMenus;
+
+/* marks the "all monitors" entry in unpopulatedMenus */
+constexpr size_t allMonitors = (size_t) -1;
 
 struct ColorProcContext {
     TrayMenu* instance;
@@ -84,66 +105,152 @@ static void refocus(HWND hwnd) {
     SetFocus(hwnd);
 }
 
+static void populateMonitorMenu(HMENU menu, UINT_PTR baseId, int opacity, int temp) {
+    /* "brightness" submenu */
+    HMENU brightnessMenu = CreatePopupMenu();
+    for (int j = 0; j < 10; j++) {
+        const int currentValue = j * 10;
+
+        const std::wstring title = (j == 0)
+            ? L"full brightness"
+            : std::to_wstring(100 - currentValue) + L"%";
+
+        UINT flags = (currentValue == opacity) ? MF_CHECKED : 0;
+        AppendMenu(brightnessMenu, flags, baseId + currentValue, title.c_str());
+    }
+
+    /* "temperature" submenu */
+    HMENU tempMenu = CreatePopupMenu();
+    AppendMenu(tempMenu, checked(temp, -1), baseId + MENU_ID_DEFAULTK, L"default");
+    AppendMenu(tempMenu, checked(temp, 4500), baseId + MENU_ID_4500K, L"4500k");
+    AppendMenu(tempMenu, checked(temp, 5000), baseId + MENU_ID_5000K, L"5000k");
+    AppendMenu(tempMenu, checked(temp, 5500), baseId + MENU_ID_5500K, L"5500k");
+    AppendMenu(tempMenu, checked(temp, 6000), baseId + MENU_ID_6000K, L"6000k");
+
+    /* brightness, temperature popup */
+    AppendMenu(menu, MF_POPUP, (UINT_PTR) brightnessMenu, L"brightness");
+    AppendMenu(menu, MF_POPUP, (UINT_PTR) tempMenu, L"temperature");
+}
+
+static int opacityPercent(Monitor& monitor) {
+    return (int) round(getMonitorOpacity(monitor) * 100.0f);
+}
+
+/* called from WM_INITMENUPOPUP; per-monitor submenus are only built when
+they're about to be shown, so opening the tray menu stays cheap with a lot
+of monitors attached. */
+static void populateMenu(HMENU submenu) {
+    auto it = unpopulatedMenus.find(submenu);
+    if (it == unpopulatedMenus.end()) {
+        return;
+    }
+
+    const size_t index = it->second;
+    unpopulatedMenus.erase(it);
+
+    if (index == allMonitors) {
+        /* only show a check if every monitor agrees */
+        int opacity = opacityPercent(menuMonitors[0]);
+        int temp = getMonitorTemperature(menuMonitors[0]);
+        for (auto& m : menuMonitors) {
+            opacity = (opacityPercent(m) == opacity) ? opacity : INT_MIN;
+            temp = (getMonitorTemperature(m) == temp) ? temp : INT_MIN;
+        }
+        populateMonitorMenu(submenu, MENU_ID_ALL_BASE, opacity, temp);
+    }
+    else if (index < menuMonitors.size()) {
+        Monitor& m = menuMonitors[index];
+        populateMonitorMenu(
+            submenu,
+            MENU_ID_MONITOR_BASE + (index * MENU_ID_MONITOR_STRIDE),
+            opacityPercent(m),
+            getMonitorTemperature(m));
+    }
+}
+
 static HMENU createMenu(HWND hwnd) {
+    metrics::Scope scope(metrics::CreateMenu);
+
     if (menu) {
         DestroyMenu(menu);
     }
 
     menu = CreatePopupMenu();
+    menuMonitors = queryMonitors();
+    unpopulatedMenus.clear();
 
-    auto monitors = queryMonitors();
-    int i = 1;
-    for (auto m : monitors) {
-        const int checkedValue = (int) round(getMonitorOpacity(m) * 100.0f);
-        UINT_PTR baseId = (MENU_ID_MONITOR_BASE * i++);
-
-        /* "brightness" submenu */
-        HMENU brightnessMenu = CreatePopupMenu();
-        UINT_PTR menuId;
-        for (int j = 0; j < 10; j++) {
-            const int currentValue = j * 10;
-
-            const std::wstring title = (j == 0)
-                ? L"full brightness"
-                : std::to_wstring(100 - currentValue) + L"%";
-
-            UINT flags = (currentValue == checkedValue) ? MF_CHECKED : 0;
-            menuId = baseId + (j * 10);
-            AppendMenu(brightnessMenu, flags, menuId, title.c_str());
-        }
+    const size_t maxMonitors =
+        (0xffff - MENU_ID_MONITOR_BASE) / MENU_ID_MONITOR_STRIDE;
+
+    const size_t count = std::min(menuMonitors.size(), maxMonitors);
+    UINT submenuEnabled = isDimmerEnabled() ? MF_ENABLED : MF_DISABLED;
+
+    if (count > 1) {
+        HMENU allMenu = CreatePopupMenu();
+        unpopulatedMenus[allMenu] = allMonitors;
+        AppendMenu(menu, MF_POPUP | submenuEnabled, (UINT_PTR) allMenu, L"all monitors");
+        AppendMenu(menu, MF_SEPARATOR, 0, L"-");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        HMENU monitorMenu = CreatePopupMenu();
+        unpopulatedMenus[monitorMenu] = i;
 
-        /* "temperature" submenu */
-        HMENU tempMenu = CreatePopupMenu();
-        const int currentTemp = getMonitorTemperature(m);
-        AppendMenu(tempMenu, checked(currentTemp, -1), baseId + MENU_ID_DEFAULTK, L"default");
-        AppendMenu(tempMenu, checked(currentTemp, 4500), baseId + MENU_ID_4500K, L"4500k");
-        AppendMenu(tempMenu, checked(currentTemp, 5000), baseId + MENU_ID_5000K, L"5000k");
-        AppendMenu(tempMenu, checked(currentTemp, 5500), baseId + MENU_ID_5500K, L"5500k");
-        AppendMenu(tempMenu, checked(currentTemp, 6000), baseId + MENU_ID_6000K, L"6000k");
-
-        /* brightness, temperature popup */
-        HMENU brightTempMenu = CreatePopupMenu();
-        AppendMenu(brightTempMenu, MF_POPUP, (UINT_PTR) brightnessMenu, L"brightness");
-        AppendMenu(brightTempMenu, MF_POPUP, (UINT_PTR) tempMenu, L"temperature");
-
-        /* main menu */
-        UINT submenuEnabled = isDimmerEnabled() ? MF_ENABLED : MF_DISABLED;
         AppendMenu(
             menu,
             MF_POPUP | submenuEnabled,
-            reinterpret_cast<UINT_PTR>(brightTempMenu),
-            m.getName().c_str());
+            reinterpret_cast<UINT_PTR>(monitorMenu),
+            menuMonitors[i].getName().c_str());
+    }
+
+    /* profile ids run from MENU_ID_PROFILE_BASE up to MENU_ID_ALL_BASE */
+    menuProfiles = getProfileNames();
+    menuProfiles.resize(std::min(menuProfiles.size(), (size_t) (MENU_ID_ALL_BASE - MENU_ID_PROFILE_BASE)));
+    if (menuProfiles.size() > 1) {
+        HMENU profileMenu = CreatePopupMenu();
+        for (size_t i = 0; i < menuProfiles.size(); i++) {
+            const bool active = (menuProfiles[i] == getActiveProfile());
+            AppendMenu(
+                profileMenu,
+                active ? MF_CHECKED : MF_UNCHECKED,
+                MENU_ID_PROFILE_BASE + i,
+                u8to16(menuProfiles[i]).c_str());
+        }
+        AppendMenu(menu, MF_SEPARATOR, 0, L"-");
+        AppendMenu(menu, MF_POPUP, reinterpret_cast<UINT_PTR>(profileMenu), L"profile");
     }
 
     bool poll = isPollingEnabled();
     AppendMenu(menu, MF_SEPARATOR, 0, L"-");
     AppendMenu(menu, isDimmerEnabled() ? MF_CHECKED : MF_UNCHECKED, MENU_ID_ENABLED, L"enabled");
     AppendMenu(menu, poll ? MF_CHECKED : MF_UNCHECKED, MENU_ID_POLL, L"dim popups");
+    AppendMenu(menu, isAdaptiveEnabled() ? MF_CHECKED : MF_UNCHECKED, MENU_ID_ADAPTIVE, L"adapt to content");
+    AppendMenu(menu, isAmbientEnabled() ? MF_CHECKED : MF_UNCHECKED, MENU_ID_AMBIENT, L"adapt to room light");
+    AppendMenu(menu, isFocusFollowEnabled() ? MF_CHECKED : MF_UNCHECKED, MENU_ID_FOCUS, L"dim unfocused monitors");
+    AppendMenu(menu, isPanelDimmingEnabled() ? MF_CHECKED : MF_UNCHECKED, MENU_ID_PANEL, L"dim laptop backlight");
     AppendMenu(menu, MF_SEPARATOR, 0, L"-");
     AppendMenu(menu, 0, MENU_ID_EXIT, L"exit");
     return menu;
 }
 
+static void applyMenuValue(Monitor& monitor, UINT_PTR value) {
+    if (value >= MENU_ID_DEFAULTK && value <= MENU_ID_6000K) {
+        int temperature = -1;
+        switch (value) {
+            case MENU_ID_4500K: temperature = 4500; break;
+            case MENU_ID_5000K: temperature = 5000; break;
+            case MENU_ID_5500K: temperature = 5500; break;
+            case MENU_ID_6000K: temperature = 6000; break;
+        }
+        setMonitorTemperature(monitor, temperature);
+    }
+    /* if above MENU_ID_MONITOR_USER it's not one of the % toggles */
+    else if (value < MENU_ID_MONITOR_USER) {
+        float opacity = (float)value / 100;
+        setMonitorOpacity(monitor, opacity);
+    }
+}
+
 static void registerClass(HINSTANCE instance, WNDPROC wndProc) {
     if (!trayIcon) {
         trayIcon = (HICON) ::LoadIconW(
@@ -163,6 +270,7 @@ static void registerClass(HINSTANCE instance, WNDPROC wndProc) {
 TrayMenu::TrayMenu(HINSTANCE instance, MonitorsChanged callback) {
     this->monitorsChanged = callback;
     this->middleFlags = 0;
+    this->typedMonitor = 0;
 
     registerClass(instance, &windowProc);
 
@@ -221,6 +329,39 @@ void TrayMenu::initIcon() {
     Shell_NotifyIcon(NIM_SETVERSION, &this->iconData);
 }
 
+/* `number` is 1-based, as shown in the menu */
+void TrayMenu::toggleMonitor(int number) {
+    auto monitors = queryMonitors();
+    if (number >= 1 && (size_t) number <= monitors.size()) {
+        auto& monitor = monitors[number - 1];
+        setMonitorEnabled(monitor, !isMonitorEnabled(monitor));
+        this->monitorsChanged();
+        refocus(this->hwnd);
+        this->middleFlags |= MiddleProcessed;
+    }
+}
+
+/* if any monitors are enabled, disables them all, otherwise enables them
+all. */
+void TrayMenu::toggleAllMonitors() {
+    auto monitors = queryMonitors();
+    bool anyEnabled = false;
+    for (auto& monitor : monitors) {
+        anyEnabled = anyEnabled || isMonitorEnabled(monitor);
+    }
+
+    {
+        ConfigBatch batch;
+        for (auto& monitor : monitors) {
+            setMonitorEnabled(monitor, !anyEnabled);
+        }
+    }
+
+    this->monitorsChanged();
+    refocus(this->hwnd);
+    this->middleFlags |= MiddleProcessed;
+}
+
 void TrayMenu::setPopupMenuChangedCallback(PopupMenuChanged callback) {
     this->popupMenuChanged = callback;
 }
@@ -230,16 +371,33 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
         case WM_KEYDOWN: {
             auto instance = hwndToInstance.find(hwnd)->second;
             if ((instance->middleFlags & MiddleDown) != 0) {
-                /* 1 through 9 */
-                if (wParam >= 0x31 && wParam <= 0x39) {
-                    size_t index = wParam - 0x31;
-                    auto monitors = queryMonitors();
-                    if (monitors.size() > index) {
-                        auto monitor = monitors[index];
-                        setMonitorEnabled(monitor, !isMonitorEnabled(monitor));
-                        instance->monitorsChanged();
-                        refocus(hwnd);
-                        instance->middleFlags |= MiddleProcessed;
+                int digit = -1;
+                if (wParam >= 0x30 && wParam <= 0x39) {
+                    digit = (int) (wParam - 0x30);
+                }
+                else if (wParam >= VK_NUMPAD0 && wParam <= VK_NUMPAD9) {
+                    digit = (int) (wParam - VK_NUMPAD0);
+                }
+
+                /* a leading 0: all monitors */
+                if (digit == 0 && instance->typedMonitor == 0) {
+                    instance->toggleAllMonitors();
+                }
+                /* monitor numbers can have more than one digit. a number is
+                applied as soon as another digit couldn't name a monitor, or
+                when the middle button is released. */
+                else if (digit >= 0) {
+                    const int count = (int) queryMonitors().size();
+                    const int number = instance->typedMonitor * 10 + digit;
+                    instance->typedMonitor = 0;
+                    if (number > count) {
+                        /* no such monitor; start over */
+                    }
+                    else if (number * 10 > count) {
+                        instance->toggleMonitor(number);
+                    }
+                    else {
+                        instance->typedMonitor = number;
                     }
                 }
                 return 1;
@@ -262,6 +420,11 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
             }
 
             if (type == WM_MBUTTONUP) {
+                if (instance->typedMonitor > 0) {
+                    instance->toggleMonitor(instance->typedMonitor);
+                    instance->typedMonitor = 0;
+                }
+
                 if ((instance->middleFlags & MiddleProcessed) == 0) {
                     setDimmerEnabled(!isDimmerEnabled());
                     instance->notify();
@@ -307,31 +470,34 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
                 else if (id == MENU_ID_ENABLED) {
                     setDimmerEnabled(!isDimmerEnabled());
                 }
+                else if (id == MENU_ID_ADAPTIVE) {
+                    setAdaptiveEnabled(!isAdaptiveEnabled());
+                }
+                else if (id == MENU_ID_AMBIENT) {
+                    setAmbientEnabled(!isAmbientEnabled());
+                }
+                else if (id == MENU_ID_FOCUS) {
+                    setFocusFollowEnabled(!isFocusFollowEnabled());
+                }
+                else if (id == MENU_ID_PANEL) {
+                    setPanelDimmingEnabled(!isPanelDimmingEnabled());
+                }
+                else if (id >= MENU_ID_PROFILE_BASE && id < MENU_ID_PROFILE_BASE + menuProfiles.size()) {
+                    /* the list was captured when the menu opened; a profile
+                    removed from config.json since then is just ignored. */
+                    setActiveProfile(menuProfiles[id - MENU_ID_PROFILE_BASE]);
+                }
+                else if (id >= MENU_ID_ALL_BASE && id < MENU_ID_ALL_BASE + MENU_ID_MONITOR_STRIDE) {
+                    ConfigBatch batch;
+                    for (auto& monitor : menuMonitors) {
+                        applyMenuValue(monitor, id - MENU_ID_ALL_BASE);
+                    }
+                }
                 else if (id >= MENU_ID_MONITOR_BASE) {
-                    auto index = (id / MENU_ID_MONITOR_BASE) - 1;
-                    auto monitors = queryMonitors();
-
-                    if (monitors.size() > (size_t)index) {
-                        auto monitor = monitors[index];
-                        auto value = id - (MENU_ID_MONITOR_BASE * (index + 1));
-
-                        if (value >= MENU_ID_DEFAULTK && value <= MENU_ID_6000K) {
-                            int temperature = -1;
-                            switch (value) {
-                                case MENU_ID_4500K: temperature = 4500; break;
-                                case MENU_ID_5000K: temperature = 5000; break;
-                                case MENU_ID_5500K: temperature = 5500; break;
-                                case MENU_ID_6000K: temperature = 6000; break;
-                            }
-                            setMonitorTemperature(monitor, temperature);
-                        }
-                        else if (id >= MENU_ID_MONITOR_BASE) {
-                            /* if above MENU_ID_MONITOR_USER it's not one of the % toggles */
-                            if (value < MENU_ID_MONITOR_USER) {
-                                float opacity = (float)value / 100;
-                                setMonitorOpacity(monitor, opacity);
-                            }
-                        }
+                    size_t index = (id - MENU_ID_MONITOR_BASE) / MENU_ID_MONITOR_STRIDE;
+                    if (menuMonitors.size() > index) {
+                        UINT_PTR value = (id - MENU_ID_MONITOR_BASE) % MENU_ID_MONITOR_STRIDE;
+                        applyMenuValue(menuMonitors[index], value);
                     }
                 }
 
@@ -344,6 +510,11 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
             return 0;
         }
 
+        case WM_INITMENUPOPUP: {
+            populateMenu(reinterpret_cast<HMENU>(wParam));
+            return 0;
+        }
+
         case WM_DISPLAYCHANGE: {
             hwndToInstance.find(hwnd)->second->notify();
             break;
@@ -57,6 +57,8 @@ namespace dimmer {
             };
 
             void initIcon();
+            void toggleMonitor(int number);
+            void toggleAllMonitors();
 
             void notify() {
                 if (monitorsChanged) {
@@ -69,6 +71,7 @@ namespace dimmer {
 
             HWND hwnd;
             int middleFlags;
+            int typedMonitor; /* digits typed so far while middle is held */
             NOTIFYICONDATA iconData;
             MonitorsChanged monitorsChanged;
             PopupMenuChanged popupMenuChanged;
@@ -38,22 +38,21 @@
 
 namespace dimmer {
     std::string u16to8(const std::wstring& utf16) {
-        int size = WideCharToMultiByte(CP_UTF8, 0, utf16.c_str(), -1, 0, 0, 0, 0);
+        /* convert straight into the result's storage; no temporary buffer. */
+        const int length = (int) utf16.size();
+        int size = WideCharToMultiByte(CP_UTF8, 0, utf16.c_str(), length, 0, 0, 0, 0);
         if (size <= 0) return "";
-        char* buffer = new char[size];
-        WideCharToMultiByte(CP_UTF8, 0, utf16.c_str(), -1, buffer, size, 0, 0);
-        std::string utf8str(buffer);
-        delete[] buffer;
+        std::string utf8str(size, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, utf16.c_str(), length, &utf8str[0], size, 0, 0);
         return utf8str;
     }
 
     std::wstring u8to16(const std::string& utf8) {
-        int size = MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), -1, 0, 0);
+        const int length = (int) utf8.size();
+        int size = MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), length, 0, 0);
         if (size <= 0) return L"";
-        wchar_t* buffer = new wchar_t[size];
-        MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), -1, buffer, size);
-        std::wstring utf16fn(buffer);
-        delete[] buffer;
+        std::wstring utf16fn(size, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), length, &utf16fn[0], size);
         return utf16fn;
     }
 
@@ -88,7 +87,9 @@ namespace dimmer {
             return false;
         }
 
-        size_t written = fwrite(str.c_str(), str.size(), 1, f);
+        /* one-byte items, so the return value is a byte count that can be
+        compared with the string length. */
+        size_t written = fwrite(str.c_str(), 1, str.size(), f);
         fclose(f);
         return (written == str.size());
     }
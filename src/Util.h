@@ -35,6 +35,7 @@
 #pragma once
 
 #include <string>
+#include <utility>
 
 namespace dimmer {
     extern std::string fileToString(const std::wstring& fn);
@@ -42,4 +43,23 @@ namespace dimmer {
     extern std::wstring getDataDirectory();
     extern std::string u16to8(const std::wstring& input);
     extern std::wstring u8to16(const std::string& input);
+
+    /* just enough ownership for the COM calls we make (WMI, sensors) */
+    template <typename T>
+    class Com {
+        public:
+            Com() : p(nullptr) { }
+            ~Com() { this->reset(); }
+            Com(const Com&) = delete;
+            Com& operator=(const Com&) = delete;
+
+            T** out() { this->reset(); return &this->p; }
+            T* operator->() const { return this->p; }
+            T* get() const { return this->p; }
+            void reset() { if (this->p) { this->p->Release(); this->p = nullptr; } }
+            void swap(Com& other) { std::swap(this->p, other.p); }
+
+        private:
+            T* p;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,561 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "../Adaptive.h"
+#include "../Control.h"
+#include "../GammaRamp.h"
+#include "../Metrics.h"
+#include "../Monitor.h"
+#include "../ToneCurve.h"
+#include "../Util.h"
+#include "../json.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* micro benchmarks for the parts of dimmer that don't need real displays.
+monitors are simulated: Monitor objects built from fake handles get a unique
+id from their index, which is all the options store cares about. config i/o
+goes to a scratch %APPDATA%, never the real one.
+
+results are written to stdout as json lines, one per case, e.g.
+
+    {"case":"config_load","n":1000,"iterations":64,"min_ns":...,"median_ns":...}
+
+`n` is the case's size parameter (monitors, string length, ...), and the
+times are per iteration. redirect to a file and diff between releases. pass
+a case name prefix to only run matching cases. */
+
+using namespace dimmer;
+using json = nlohmann::json;
+
+static const int samples = 7;
+static const double minimumSampleSeconds = 0.02;
+static std::string filter;
+static bool overBudget = false;
+
+static double now() {
+    static double ticksToSeconds = 0.0;
+    if (ticksToSeconds == 0.0) {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        ticksToSeconds = 1.0 / (double) frequency.QuadPart;
+    }
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    return (double) ticks.QuadPart * ticksToSeconds;
+}
+
+static bool selected(const std::string& name) {
+    return name.compare(0, filter.size(), filter) == 0;
+}
+
+/* runs `body` enough times for each sample to take at least
+minimumSampleSeconds, then reports the fastest and median sample. returns
+the median, or 0 if the case was filtered out. */
+static double measure(const std::string& name, int n, std::function<void()> body) {
+    if (!selected(name)) {
+        return 0.0;
+    }
+
+    uint64_t iterations = 1;
+    while (true) {
+        double start = now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            body();
+        }
+        if (now() - start >= minimumSampleSeconds || iterations >= (1ull << 30)) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    std::vector<double> results;
+    for (int s = 0; s < samples; s++) {
+        double start = now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            body();
+        }
+        results.push_back((now() - start) * 1e9 / (double) iterations);
+    }
+
+    std::sort(results.begin(), results.end());
+
+    printf(
+        "{\"case\":\"%s\",\"n\":%d,\"iterations\":%llu,\"min_ns\":%.1f,\"median_ns\":%.1f}\n",
+        name.c_str(),
+        n,
+        (unsigned long long) iterations,
+        results.front(),
+        results[samples / 2]);
+
+    fflush(stdout);
+    return results[samples / 2];
+}
+
+/* like measure(), but also fails the run if the median exceeds `budget`. */
+static void measure(const std::string& name, int n, double budgetNs, std::function<void()> body) {
+    double median = measure(name, n, body);
+    if (median > budgetNs) {
+        fprintf(stderr, "%s (n=%d) over budget: %.0f > %.0f ns\n", name.c_str(), n, median, budgetNs);
+        overBudget = true;
+    }
+}
+
+/* keeps the optimizer from discarding results we never look at. */
+static volatile float sink;
+
+static std::vector<Monitor> simulateMonitors(int count) {
+    std::vector<Monitor> monitors;
+    monitors.reserve(count);
+    for (int i = 0; i < count; i++) {
+        monitors.push_back(Monitor(reinterpret_cast<HMONITOR>((uintptr_t) i + 1), i));
+    }
+    return monitors;
+}
+
+/* a config.json with `count` monitors in the default profile, in the same
+shape saveConfig() produces. */
+static std::string makeConfig(int count) {
+    json j;
+    json& m = j["monitors"];
+    m = json::object();
+    for (auto& monitor : simulateMonitors(count)) {
+        m[u16to8(monitor.getId())] = {
+            { "opacity", 0.25f },
+            { "temperature", 5000 },
+            { "enabled", true },
+            { "backlight", -1 }
+        };
+    }
+    j["general"] = { { "globalEnabled", true } };
+    return j.dump(2);
+}
+
+static void benchColorTemperature() {
+    measure("color_temperature", 1, [] {
+        float r, g, b, total = 0.0f;
+        for (int kelvin = 1000; kelvin <= 10000; kelvin += 100) {
+            colorTemperatureToRgb(kelvin, r, g, b);
+            total += r + g + b;
+        }
+        sink = total;
+    });
+}
+
+/* gdi gamma ramps are always 256 entries per channel, so that's the only
+size measured. */
+static void benchRamps() {
+    WORD ramp[3][256];
+    float scale[3];
+    colorTemperatureToRgb(4500, scale[0], scale[1], scale[2]);
+
+    measure("ramp_identity", 256, [&] {
+        compileToneCurve(nullptr, scale, ramp);
+        sink = ramp[2][128];
+    });
+
+    /* the worst case a config can ask for: gamma, contrast and black lift
+    plus control points on every channel, `n` of them each. */
+    for (int points : { 2, 8, 32 }) {
+        ToneCurve curve;
+        curve.gamma = 2.2f;
+        curve.contrast = 1.2f;
+        curve.blackLift = 0.02f;
+        for (int c = 0; c < 3; c++) {
+            for (int i = 0; i < points; i++) {
+                const float x = (float) (i + 1) / (points + 1);
+                curve.points[c].push_back({ x, std::pow(x, 1.0f + 0.1f * c) });
+            }
+        }
+
+        measure("ramp_curve", points, [&] {
+            compileToneCurve(&curve, scale, ramp);
+            sink = ramp[2][128];
+        });
+    }
+}
+
+static void benchStrings() {
+    for (int length : { 16, 256, 4096 }) {
+        std::wstring wide;
+        for (int i = 0; i < length; i++) {
+            wide += (wchar_t) (L'a' + i % 26);
+        }
+        std::string narrow = u16to8(wide);
+
+        measure("u16to8", length, [&] {
+            sink = (float) u16to8(wide).size();
+        });
+
+        measure("u8to16", length, [&] {
+            sink = (float) u8to16(narrow).size();
+        });
+    }
+}
+
+static void benchConfig() {
+    const std::wstring filename = getDataDirectory() + L"\\config.json";
+
+    for (int count : { 1, 10, 100, 1000, 10000 }) {
+        /* loadConfig() always does the full parse and apply, so the file is
+        written once and only the load is timed. */
+        stringToFile(filename, makeConfig(count));
+        measure("config_load", count, [&] {
+            loadConfig();
+        });
+
+        /* the ui thread's share of a save: serializing and queueing. the
+        writer stays up for the whole case, as it does in dimmer, and the
+        queued writes are drained once afterwards. */
+        measure("config_save", count, [&] {
+            saveConfig();
+        });
+        flushConfig();
+    }
+}
+
+static void benchLookup() {
+    for (int count : { 1, 16, 128, 1024 }) {
+        stringToFile(getDataDirectory() + L"\\config.json", makeConfig(count));
+        loadConfig();
+        auto monitors = simulateMonitors(count);
+
+        measure("options_lookup", count, [&] {
+            float total = 0.0f;
+            for (auto& monitor : monitors) {
+                total += getMonitorOpacity(monitor);
+            }
+            sink = total;
+        });
+    }
+}
+
+/* the per-monitor state half of updateOverlays(): everything an overlay
+asks for when it's updated. */
+static void benchReconcile() {
+    for (int count : { 1, 2, 4, 8, 16, 32, 64, 128 }) {
+        stringToFile(getDataDirectory() + L"\\config.json", makeConfig(count));
+        loadConfig();
+        auto monitors = simulateMonitors(count);
+
+        measure("reconcile", count, [&] {
+            float total = 0.0f;
+            for (auto& monitor : monitors) {
+                if (isMonitorEnabled(monitor)) {
+                    total += getEffectiveOpacity(monitor);
+                    total += getGammaBrightness(monitor);
+                    total += (float) getEffectiveTemperature(monitor);
+                    total += (float) getMonitorBacklight(monitor);
+                    total += getMonitorToneCurve(monitor) ? 1.0f : 0.0f;
+                }
+            }
+            sink = total;
+        });
+    }
+}
+
+/* the gamma half: what each overlay does when its temperature changed,
+short of the driver calls. the ramp comes from the prepared cache, goes
+through the device's calibration, and the result is hashed as the read back
+would be. every monitor gets its own calibration, as real ones do. */
+static void benchReconcileRamps() {
+    prepareGammaRamps({ { nullptr, 4000 }, { nullptr, 5000 } }, { 100 });
+
+    for (int count : { 1, 2, 4, 8, 16, 32, 64, 128 }) {
+        std::vector<GammaRamp> baselines(count);
+        for (int i = 0; i < count; i++) {
+            const float gamma = 0.9f + 0.2f * i / count;
+            for (int c = 0; c < 3; c++) {
+                for (int j = 0; j < 256; j++) {
+                    baselines[i].values[c][j] = (WORD) (std::pow(j / 255.0f, gamma) * 65535.0f);
+                }
+            }
+        }
+
+        int round = 0;
+        measure("reconcile_ramps", count, [&] {
+            const int temperature = (++round & 1) ? 4000 : 5000;
+            uint64_t total = 0;
+            GammaRamp composed;
+            for (auto& baseline : baselines) {
+                composeRamp(baseline, getGammaRamp(nullptr, temperature, 100), composed);
+                total += hashRamp(composed);
+            }
+            sink = (float) (total & 0xffff);
+        });
+    }
+}
+
+/* the cost instrumentation adds to every instrumented call: record() alone
+has to stay under 50ns. the scope adds two QueryPerformanceCounter() calls
+and a trace check, and is reported for reference. samples are spread across
+the histogram's buckets so the bucket search isn't always the shortest. */
+static void benchMetrics() {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    int64_t durations[16];
+    for (int i = 0; i < 16; i++) {
+        durations[i] = (frequency.QuadPart << i) / 1000000; /* 2^i microseconds */
+    }
+
+    int i = 0;
+    measure("metrics_record", 1, 50.0, [&] {
+        metrics::record(metrics::UpdateOverlay, durations[++i & 15]);
+    });
+
+    measure("metrics_scope", 1, [&] {
+        metrics::Scope scope(metrics::UpdateOverlay);
+    });
+}
+
+/* what a click or hotkey costs the ui thread on a video wall: toggling one
+monitor (which serializes the whole config) and a bulk change to all of
+them, each followed by the reconcile. the writes themselves happen on the
+writer thread. both have to fit in a 60hz frame. */
+static void benchInteraction() {
+    const int count = 256;
+    const double budgetNs = 16.0e6;
+
+    stringToFile(getDataDirectory() + L"\\config.json", makeConfig(count));
+    loadConfig();
+    auto monitors = simulateMonitors(count);
+
+    auto reconcile = [&] {
+        float total = 0.0f;
+        for (auto& monitor : monitors) {
+            total += getEffectiveOpacity(monitor) + (float) getEffectiveTemperature(monitor);
+        }
+        sink = total;
+    };
+
+    measure("interaction_toggle", count, budgetNs, [&] {
+        setMonitorEnabled(monitors[count / 2], !isMonitorEnabled(monitors[count / 2]));
+        reconcile();
+    });
+
+    int round = 0;
+    measure("interaction_bulk", count, budgetNs, [&] {
+        float opacity = (++round & 1) ? 0.4f : 0.6f;
+        {
+            ConfigBatch batch;
+            for (auto& monitor : monitors) {
+                setMonitorOpacity(monitor, opacity);
+            }
+        }
+        reconcile();
+    });
+
+    flushConfig();
+}
+
+/* a profile switch on a 16 monitor wall: repointing the options, queueing
+the config write and the reconcile that follows. the ramps are prepared at
+load, so none are built here. */
+static void benchProfiles() {
+    const int count = 16;
+
+    stringToFile(getDataDirectory() + L"\\config.json", makeConfig(count));
+    loadConfig();
+    auto monitors = simulateMonitors(count);
+    createProfile("night");
+    setActiveProfile("night");
+    for (auto& monitor : monitors) {
+        setMonitorOpacity(monitor, 0.6f);
+        setMonitorTemperature(monitor, 3400);
+    }
+
+    int round = 0;
+    measure("profile_switch", count, 16.0e6, [&] {
+        setActiveProfile((++round & 1) ? "default" : "night");
+        float total = 0.0f;
+        for (auto& monitor : monitors) {
+            total += getEffectiveOpacity(monitor) + getGammaBrightness(monitor);
+            total += (float) getEffectiveTemperature(monitor);
+        }
+        sink = total;
+    });
+
+    flushConfig();
+}
+
+/* adaptive dimming samples every monitor once a second, so staying under
+0.5% of a core leaves 5ms per sample for all of them together; a single 4K
+monitor's capture has to fit in that. the kernel runs over a synthetic
+64x36 capture. the capture itself is a StretchBlt() of each attached
+monitor into the sampler's dib and needs a real display, so it's only
+reported for the monitors there are. */
+static void benchAdaptive() {
+    std::vector<uint32_t> pixels(64 * 36);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        const uint32_t v = (uint32_t) (i * 7) & 0xff;
+        pixels[i] = (v << 16) | (((v * 3) & 0xff) << 8) | (255 - v);
+    }
+
+    measure("adaptive_luminance", (int) pixels.size(), [&] {
+        sink = measureLuminance(pixels.data(), (int) pixels.size());
+    });
+
+    if (!selected("adaptive_capture")) {
+        return;
+    }
+
+    LuminanceSampler sampler;
+    HDC screen = GetDC(nullptr);
+    for (auto& monitor : queryMonitors()) {
+        const RECT& rect = monitor.info.rcMonitor;
+        measure("adaptive_capture", rect.right - rect.left, 5.0e6, [&] {
+            sink = sampler.sample(screen, rect);
+        });
+    }
+    ReleaseDC(nullptr, screen);
+}
+
+/* request to reply over the control pipe, with the client on this thread
+and the server's ui thread on another, as with a real client. the pipe gets
+its own name so a running dimmer doesn't get in the way.
+
+control_get is the transport alone. control_set changes the temperature on
+every attached monitor and only gets its reply once the settings callback
+has rebuilt each monitor's ramp, so it covers command to applied ramp, less
+the SetDeviceGammaRamp() call itself. with no monitors attached it's the
+same as control_get. */
+static void benchControl() {
+    if (!selected("control_get") && !selected("control_set")) {
+        return;
+    }
+
+    const std::wstring name =
+        L"\\\\.\\pipe\\dimmer-bench-" + std::to_wstring(GetCurrentProcessId());
+
+    HANDLE ready = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    DWORD serverThreadId = 0;
+
+    std::thread server([&] {
+        std::vector<Monitor> monitors;
+        Control control(GetModuleHandle(nullptr), [&monitors] {
+            WORD ramp[3][256];
+            float scale[3];
+            monitors = queryMonitors();
+            for (auto& monitor : monitors) {
+                colorTemperatureToRgb(getEffectiveTemperature(monitor), scale[0], scale[1], scale[2]);
+                compileToneCurve(getMonitorToneCurve(monitor).get(), scale, ramp);
+                sink = ramp[2][128];
+            }
+        }, name);
+
+        MSG msg;
+        PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE); /* creates the queue */
+        serverThreadId = GetCurrentThreadId();
+        SetEvent(ready);
+
+        while (GetMessage(&msg, nullptr, 0, 0) > 0) {
+            DispatchMessage(&msg);
+        }
+    });
+
+    WaitForSingleObject(ready, INFINITE);
+
+    HANDLE pipe = CreateFile(
+        name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+
+    if (pipe != INVALID_HANDLE_VALUE) {
+        DWORD mode = PIPE_READMODE_MESSAGE;
+        SetNamedPipeHandleState(pipe, &mode, nullptr, nullptr);
+
+        char reply[256];
+        auto transact = [&](const std::string& request) {
+            DWORD bytes = 0;
+            TransactNamedPipe(
+                pipe, (void*) request.c_str(), (DWORD) request.size(),
+                reply, sizeof(reply), &bytes, nullptr);
+            sink = (float) bytes;
+        };
+
+        const int count = (int) queryMonitors().size();
+
+        measure("control_get", 1, [&] {
+            transact("get general enabled");
+        });
+
+        int round = 0;
+        measure("control_set", count, [&] {
+            transact((++round & 1) ? "set * temperature 4500" : "set * temperature 5000");
+        });
+
+        transact("set * temperature -1");
+        CloseHandle(pipe);
+    }
+    else {
+        fprintf(stderr, "control: couldn't connect to %ls\n", name.c_str());
+    }
+
+    PostThreadMessage(serverThreadId, WM_QUIT, 0, 0);
+    server.join();
+    CloseHandle(ready);
+
+    flushConfig();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        filter = argv[1];
+    }
+
+    /* keep config i/o away from the real %APPDATA%\dimmer */
+    wchar_t temp[MAX_PATH];
+    GetTempPath(MAX_PATH, temp);
+    std::wstring appData = std::wstring(temp) + L"dimmer-bench";
+    SetEnvironmentVariable(L"APPDATA", appData.c_str());
+
+    benchColorTemperature();
+    benchMetrics();
+    benchRamps();
+    benchStrings();
+    benchLookup();
+    benchReconcile();
+    benchReconcileRamps();
+    benchConfig();
+    benchInteraction();
+    benchProfiles();
+    benchAdaptive();
+    benchControl();
+
+    flushConfig();
+    return overBudget ? 1 : 0;
+}
@@ -37,9 +37,22 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <memory>
 
+#include "Adaptive.h"
+#include "Ambient.h"
+#include "Backlight.h"
+#include "Apps.h"
+#include "Control.h"
+#include "Focus.h"
+#include "Fullscreen.h"
+#include "GammaWatch.h"
+#include "Idle.h"
+#include "Metrics.h"
 #include "Monitor.h"
+#include "Status.h"
+#include "Trace.h"
 #include "Overlay.h"
 #include "TrayMenu.h"
 #include "Util.h"
@@ -47,20 +60,23 @@
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 
 using OverlayPtr = std::shared_ptr<dimmer::Overlay>;
-using Overlays = std::map<std::wstring, OverlayPtr>;
+using Overlays = std::unordered_map<std::wstring, OverlayPtr>;
 static Overlays overlays;
 static std::vector<dimmer::Monitor> monitors;
 
 static void updateOverlays(HINSTANCE instance) {
+    dimmer::metrics::Scope scope(dimmer::metrics::UpdateOverlays);
+
     monitors = dimmer::queryMonitors();
+    dimmer::backlight::prune(monitors);
 
     Overlays old;
     std::swap(overlays, old);
 
     if (dimmer::isDimmerEnabled()) {
-        for (auto monitor : monitors) {
-            auto id = monitor.getId();
-            auto it = old.find(monitor.getId());
+        for (auto& monitor : monitors) {
+            auto& id = monitor.getId();
+            auto it = old.find(id);
 
             OverlayPtr overlay;
             if (it != old.end()) {
@@ -74,17 +90,83 @@ static void updateOverlays(HINSTANCE instance) {
             overlays[id] = overlay;
         }
     }
+
+    dimmer::publishStatus(monitors);
+    dimmer::Control::notifySubscribers();
 }
 
 int CALLBACK wWinMain(HINSTANCE instance, HINSTANCE prev, LPWSTR args, int showType) {
     InitCommonControlsEx(nullptr);
 
+    if (args && wcsstr(args, L"--trace")) {
+        dimmer::trace::start(dimmer::getDataDirectory() + L"\\trace.json");
+    }
+
     dimmer::loadConfig();
+    dimmer::Overlay::prepareGammaRamps(dimmer::getProfileColorSettings());
+
+    dimmer::AdaptiveDimming adaptive([instance]() {
+        updateOverlays(instance);
+    });
+
+    dimmer::AmbientLight ambient([instance]() {
+        updateOverlays(instance);
+    });
+
+    dimmer::IdleDimming idle(instance, [instance]() {
+        updateOverlays(instance);
+    });
+
+    dimmer::FullscreenDetector fullscreen([instance]() {
+        updateOverlays(instance);
+    });
+
+    dimmer::FocusFollow focus(
+        [instance]() {
+            updateOverlays(instance);
+        },
+        []() {
+            for (auto& it : overlays) {
+                it.second->updateOpacity();
+            }
+            dimmer::publishStatus(monitors);
+        });
+
+    dimmer::AppProfiles apps([instance]() {
+        updateOverlays(instance);
+    });
 
-    dimmer::TrayMenu trayMenu(instance, [instance]() {
+    dimmer::backlight::PanelWatch panelWatch(instance, [instance]() {
         updateOverlays(instance);
     });
 
+    dimmer::GammaWatch gammaWatch(instance, [](bool& active) {
+        size_t restored = 0;
+        for (auto& it : overlays) {
+            if (it.second->verifyGammaRamp()) {
+                ++restored;
+            }
+            active = active || it.second->hasGammaRamp();
+        }
+        return restored;
+    });
+
+    /* settings changed via the tray menu, control pipe, or config.json */
+    auto settingsChanged = [instance, &adaptive, &ambient, &idle, &fullscreen, &focus, &apps, &gammaWatch]() {
+        adaptive.update();
+        ambient.update();
+        idle.update();
+        fullscreen.update();
+        focus.update();
+        apps.update();
+        dimmer::Overlay::prepareGammaRamps(dimmer::getProfileColorSettings());
+        updateOverlays(instance);
+        gammaWatch.update();
+    };
+
+    dimmer::TrayMenu trayMenu(instance, settingsChanged);
+    dimmer::Control control(instance, settingsChanged);
+
     trayMenu.setPopupMenuChangedCallback([](bool visible) {
         for (auto overlay : overlays) {
             if (visible) {
@@ -96,16 +178,50 @@ int CALLBACK wWinMain(HINSTANCE instance, HINSTANCE prev, LPWSTR args, int showT
         }
     });
 
+    /* config.json edits made by other programs are picked up as soon as the
+    directory change notification fires; there's no polling involved. */
+    HANDLE configChanged = FindFirstChangeNotification(
+        dimmer::getDataDirectory().c_str(),
+        FALSE,
+        FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+
+    DWORD handleCount = (configChanged != INVALID_HANDLE_VALUE) ? 1 : 0;
+
     MSG msg = {};
-    while (GetMessage(&msg, nullptr, 0, 0)) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+    bool running = true;
+    while (running) {
+        DWORD result = MsgWaitForMultipleObjectsEx(
+            handleCount, &configChanged, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+
+        if (handleCount && result == WAIT_OBJECT_0) {
+            FindNextChangeNotification(configChanged);
+            if (dimmer::reloadConfig()) {
+                settingsChanged();
+            }
+        }
+
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) {
+                running = false;
+                break;
+            }
+
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
+
+    if (handleCount) {
+        FindCloseChangeNotification(configChanged);
     }
 
     dimmer::saveConfig();
+    dimmer::flushConfig();
+    dimmer::trace::stop();
 
     monitors.clear();
     overlays.clear();
+    dimmer::backlight::shutdown();
 
     return 0;
 }
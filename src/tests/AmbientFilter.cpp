@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <Windows.h>
+#include "../Ambient.h"
+#include "Tests.h"
+#include <cmath>
+
+/* the ambient light curve and filter: the scale falls as the room gets
+brighter, the first reading applies at once, later ones are followed
+gradually, and changes too small to notice are never applied. */
+
+using namespace dimmer;
+
+static bool near(float a, float b) {
+    return std::fabs(a - b) < 0.001f;
+}
+
+/* steps until the filter settles; returns the number of steps taken and
+how many of them applied a new scale. */
+static int settle(AmbientFilter& filter, float& scale, int& applied) {
+    int steps = 0;
+    applied = 0;
+    bool settled = false;
+    while (!settled && steps < 1000) {
+        float next;
+        if (filter.step(next, settled)) {
+            scale = next;
+            ++applied;
+        }
+        ++steps;
+    }
+    return steps;
+}
+
+bool tests::ambientFilter() {
+    EXPECT(near(ambientScale(0.0f), 1.5f));
+    EXPECT(near(ambientScale(10.0f), 1.5f));
+    EXPECT(near(ambientScale(100.0f), 1.0f));
+    EXPECT(near(ambientScale(1000.0f), 0.5f));
+    EXPECT(near(ambientScale(100000.0f), 0.5f));
+    for (float lux = 1.0f; lux < 5000.0f; lux *= 1.5f) {
+        EXPECT(ambientScale(lux * 1.5f) <= ambientScale(lux));
+    }
+
+    AmbientFilter filter;
+    float scale = 0.0f;
+    bool settled = false;
+
+    /* nothing to do before the first reading */
+    EXPECT(!filter.step(scale, settled));
+    EXPECT(settled);
+
+    /* the first reading applies on the first step, already settled */
+    filter.add(100.0f);
+    EXPECT(filter.step(scale, settled));
+    EXPECT(near(scale, 1.0f));
+    EXPECT(settled);
+
+    /* 10% brighter is below the threshold: it settles without applying */
+    int applied = 0;
+    filter.add(110.0f);
+    settle(filter, scale, applied);
+    EXPECT(applied == 0);
+
+    /* a dark room is followed gradually, over several steps, and ends up
+    close to its point on the curve */
+    const int steps = settle(filter, scale, applied);
+    EXPECT(steps == 1); /* nothing new was added */
+    filter.add(10.0f);
+    EXPECT(settle(filter, scale, applied) > 5);
+    EXPECT(applied > 1);
+    EXPECT(std::fabs(scale - ambientScale(10.0f)) < 0.1f);
+
+    /* readings between steps: only the latest counts, so a shadow that
+    came and went before the next step leaves no trace */
+    filter.add(10000.0f);
+    filter.add(10.0f);
+    settle(filter, scale, applied);
+    EXPECT(applied == 0);
+
+    /* after a reset the next reading applies at once again */
+    filter.reset();
+    filter.add(1000.0f);
+    EXPECT(filter.step(scale, settled));
+    EXPECT(near(scale, 0.5f));
+
+    return true;
+}
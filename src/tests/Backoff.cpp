@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <Windows.h>
+#include "../GammaWatch.h"
+#include "Tests.h"
+
+/* the fallback poll's backoff: doubling from the minimum after every clean
+check, capped, and back to the minimum whenever a ramp was restored. */
+
+using namespace dimmer;
+
+bool tests::gammaWatchBackoff() {
+    const UINT schedule[] = {
+        10 * 1000, 20 * 1000, 40 * 1000, 80 * 1000, 160 * 1000, 320 * 1000,
+        maxGammaPollMs, maxGammaPollMs
+    };
+
+    UINT interval = minGammaPollMs;
+    EXPECT(interval == schedule[0]);
+    for (size_t i = 1; i < sizeof(schedule) / sizeof(schedule[0]); i++) {
+        interval = nextGammaPollMs(interval, 0);
+        EXPECT(interval == schedule[i]);
+    }
+
+    /* one restored ramp or several, from anywhere in the schedule */
+    EXPECT(nextGammaPollMs(maxGammaPollMs, 1) == minGammaPollMs);
+    EXPECT(nextGammaPollMs(minGammaPollMs, 3) == minGammaPollMs);
+    EXPECT(nextGammaPollMs(80 * 1000, 1) == minGammaPollMs);
+
+    /* out of range intervals come back into range rather than wrapping */
+    EXPECT(nextGammaPollMs(0, 0) == minGammaPollMs);
+    EXPECT(nextGammaPollMs(0xffffffff, 0) == maxGammaPollMs);
+    EXPECT(nextGammaPollMs(0x80000000, 0) == maxGammaPollMs);
+
+    return true;
+}
@@ -0,0 +1,258 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <Windows.h>
+#include "../GammaRamp.h"
+#include "Tests.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* calibration handling without a display: parsing the vcgt tag of an ICC
+profile, composing our ramp with the calibration, and choosing where the
+calibration comes from when the profile has none. profiles are built in
+memory with just enough of the format to be found: a 128 byte header, the
+tag table, and the tag data. */
+
+using namespace dimmer;
+
+static void put32(std::string& data, uint32_t value) {
+    data += (char) (value >> 24);
+    data += (char) (value >> 16);
+    data += (char) (value >> 8);
+    data += (char) value;
+}
+
+static void put16(std::string& data, uint16_t value) {
+    data += (char) (value >> 8);
+    data += (char) value;
+}
+
+/* a profile with a single tag. `declaredLength` overrides the length in the
+tag table, for truncated and oversized tags. */
+static std::string makeProfile(uint32_t signature, const std::string& tag, int64_t declaredLength = -1) {
+    std::string icc(128, '\0');
+    put32(icc, 1);
+    put32(icc, signature);
+    put32(icc, 128 + 4 + 12);
+    put32(icc, declaredLength >= 0 ? (uint32_t) declaredLength : (uint32_t) tag.size());
+    return icc + tag;
+}
+
+static std::string vcgtHeader(uint32_t type) {
+    std::string tag = "vcgt";
+    put32(tag, 0);
+    put32(tag, type);
+    return tag;
+}
+
+static std::string vcgtTable(uint16_t channels, const std::vector<uint16_t>& entries, uint16_t entrySize) {
+    std::string tag = vcgtHeader(0);
+    put16(tag, channels);
+    put16(tag, (uint16_t) (entries.size() / channels));
+    put16(tag, entrySize);
+    for (auto value : entries) {
+        if (entrySize == 2) {
+            put16(tag, value);
+        }
+        else {
+            tag += (char) value;
+        }
+    }
+    return tag;
+}
+
+static std::string vcgtFormula(double gamma, double min, double max) {
+    std::string tag = vcgtHeader(1);
+    for (int c = 0; c < 3; c++) {
+        put32(tag, (uint32_t) (int32_t) std::lround(gamma * 65536.0));
+        put32(tag, (uint32_t) (int32_t) std::lround(min * 65536.0));
+        put32(tag, (uint32_t) (int32_t) std::lround(max * 65536.0));
+    }
+    return tag;
+}
+
+static const uint32_t vcgt = 0x76636774;
+
+static void rampOf(GammaRamp& ramp, WORD (*f)(int channel, int index)) {
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 256; i++) {
+            ramp.values[c][i] = f(c, i);
+        }
+    }
+}
+
+static bool sameRamp(const GammaRamp& a, const GammaRamp& b) {
+    return memcmp(a.values, b.values, sizeof(a.values)) == 0;
+}
+
+static void parsing() {
+    GammaRamp ramp;
+
+    /* 16 bit, three channels, 256 entries: taken as is */
+    std::vector<uint16_t> entries;
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 256; i++) {
+            entries.push_back((uint16_t) (i * 200 + c));
+        }
+    }
+    EXPECT(parseProfileRamp(makeProfile(vcgt, vcgtTable(3, entries, 2)), ramp));
+    EXPECT(ramp.values[0][0] == 0 && ramp.values[1][0] == 1 && ramp.values[2][0] == 2);
+    EXPECT(ramp.values[0][255] == 255 * 200 && ramp.values[2][128] == 128 * 200 + 2);
+
+    /* 8 bit, one channel, two entries: interpolated to an identity ramp on
+    every channel */
+    EXPECT(parseProfileRamp(makeProfile(vcgt, vcgtTable(1, { 0, 255 }, 1)), ramp));
+    EXPECT(isIdentityRamp(ramp));
+    EXPECT(ramp.values[1][128] == 128 * 257 && ramp.values[2][255] == 65535);
+
+    /* 1024 entries, linearly resampled rather than picking the nearest */
+    entries.clear();
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 1024; i++) {
+            entries.push_back((uint16_t) std::lround(65535.0 * std::pow(i / 1023.0, 2.0)));
+        }
+    }
+    EXPECT(parseProfileRamp(makeProfile(vcgt, vcgtTable(3, entries, 2)), ramp));
+    EXPECT(std::abs(ramp.values[0][128] - 65535.0 * std::pow(128 / 255.0, 2.0)) < 8.0);
+    EXPECT(ramp.values[0][0] == 0 && ramp.values[0][255] == 65535);
+
+    /* formula form */
+    EXPECT(parseProfileRamp(makeProfile(vcgt, vcgtFormula(1.0, 0.0, 1.0)), ramp));
+    EXPECT(isIdentityRamp(ramp));
+    EXPECT(parseProfileRamp(makeProfile(vcgt, vcgtFormula(2.2, 0.1, 0.9)), ramp));
+    EXPECT(std::abs(ramp.values[0][0] - 0.1 * 65535.0) <= 1.0);
+    EXPECT(std::abs(ramp.values[2][255] - 0.9 * 65535.0) <= 1.0);
+    EXPECT(std::abs(ramp.values[1][128] - 65535.0 * (0.1 + 0.8 * std::pow(128 / 255.0, 2.2))) < 1.0);
+
+    /* not usable: nothing written, so the caller falls back */
+    const std::string table = vcgtTable(3, entries, 2);
+    EXPECT(!parseProfileRamp(std::string(), ramp));
+    EXPECT(!parseProfileRamp(std::string(100, '\0'), ramp));
+    EXPECT(!parseProfileRamp(makeProfile(0x64657363 /* 'desc' */, table), ramp));
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, table).substr(0, 200), ramp)); /* file cut short */
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, table, 17), ramp)); /* tag shorter than its header */
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, table, table.size() - 1), ramp)); /* entries overrun the tag */
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, table, 0xffffffffull), ramp)); /* length past the file */
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, vcgtFormula(2.2, 0.0, 1.0), 47), ramp));
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, vcgtFormula(0.0, 0.0, 1.0)), ramp));
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, vcgtTable(2, { 0, 1, 2, 3 }, 2)), ramp));
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, vcgtTable(1, { 0, 255 }, 3)), ramp));
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, vcgtTable(1, { 0 }, 2)), ramp));
+    EXPECT(!parseProfileRamp(makeProfile(vcgt, vcgtHeader(2) + std::string(36, '\0')), ramp));
+}
+
+static void composing() {
+    GammaRamp identity, ramp, baseline, out;
+    identityRamp(identity);
+
+    rampOf(ramp, [](int c, int i) { return (WORD) (i * 200 + c); });
+    composeRamp(identity, ramp, out);
+    EXPECT(sameRamp(out, ramp));
+
+    /* a calibration that roughly halves everything (i * 128 rather than
+    i * 257), applied after our ramp */
+    rampOf(baseline, [](int c, int i) { return (WORD) (i * 128); });
+    composeRamp(baseline, identity, out);
+    EXPECT(sameRamp(out, baseline));
+
+    composeRamp(baseline, ramp, out);
+    EXPECT(out.values[0][0] == 0);
+    EXPECT(std::abs(out.values[0][100] - 100 * 200 * 128.0 / 257.0) < 2.0);
+    EXPECT(std::abs(out.values[2][255] - (255 * 200 + 2) * 128.0 / 257.0) < 2.0);
+
+    /* full scale maps to the calibration's last entry */
+    rampOf(ramp, [](int c, int i) { return (WORD) 65535; });
+    composeRamp(baseline, ramp, out);
+    EXPECT(out.values[1][7] == baseline.values[1][255]);
+}
+
+static void fallback() {
+    GammaRamp identity, device, profile, baseline;
+    identityRamp(identity);
+    rampOf(device, [](int c, int i) { return (WORD) (i * 250); });
+    const std::string icc = makeProfile(vcgt, vcgtFormula(2.0, 0.0, 1.0));
+    parseProfileRamp(icc, profile);
+
+    /* the profile wins over whatever the device has */
+    bool hasBaseline = false;
+    updateBaseline(icc, &device, false, baseline, hasBaseline);
+    EXPECT(hasBaseline && sameRamp(baseline, profile));
+
+    /* without one, the device's ramp is the calibration */
+    hasBaseline = false;
+    updateBaseline(std::string(), &device, false, baseline, hasBaseline);
+    EXPECT(hasBaseline && sameRamp(baseline, device));
+
+    /* a broken profile is no profile */
+    hasBaseline = false;
+    updateBaseline(icc.substr(0, 150), &device, false, baseline, hasBaseline);
+    EXPECT(hasBaseline && sameRamp(baseline, device));
+
+    /* nothing to go on: identity the first time, otherwise keep what we had */
+    hasBaseline = false;
+    updateBaseline(std::string(), nullptr, false, baseline, hasBaseline);
+    EXPECT(hasBaseline && sameRamp(baseline, identity));
+    baseline = device;
+    updateBaseline(std::string(), nullptr, false, baseline, hasBaseline);
+    EXPECT(sameRamp(baseline, device));
+
+    /* one of our own ramps isn't a calibration */
+    GammaRamp ours;
+    rampOf(ours, [](int c, int i) { return (WORD) (i * 100); });
+    updateBaseline(std::string(), &ours, true, baseline, hasBaseline);
+    EXPECT(sameRamp(baseline, device));
+    hasBaseline = false;
+    updateBaseline(std::string(), &ours, true, baseline, hasBaseline);
+    EXPECT(hasBaseline && sameRamp(baseline, identity));
+
+    /* an identity ramp after a mode change is the driver's reset, not a new
+    calibration, but it's a fine first baseline */
+    baseline = device;
+    hasBaseline = true;
+    updateBaseline(std::string(), &identity, false, baseline, hasBaseline);
+    EXPECT(sameRamp(baseline, device));
+    hasBaseline = false;
+    updateBaseline(std::string(), &identity, false, baseline, hasBaseline);
+    EXPECT(hasBaseline && sameRamp(baseline, identity));
+}
+
+bool tests::calibration() {
+    parsing();
+    composing();
+    fallback();
+    return true;
+}
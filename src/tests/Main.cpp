@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <Windows.h>
+#include "../Monitor.h"
+#include "Tests.h"
+#include <cstring>
+#include <string>
+
+/* runs every suite, or only those whose name starts with the first argument.
+config i/o goes to a scratch %APPDATA%, never the real one. exits non-zero
+if any suite failed. */
+
+namespace tests {
+    static int failures = 0;
+
+    bool expect(bool condition, const char* text, const char* file, int line) {
+        if (!condition) {
+            printf("  %s(%d): expected %s\n", file, line, text);
+            ++failures;
+        }
+        return condition;
+    }
+}
+
+struct Suite {
+    const char* name;
+    bool (*run)();
+};
+
+static const Suite suites[] = {
+    { "ambient_filter", &tests::ambientFilter },
+    { "calibration", &tests::calibration },
+    { "gamma_watch_backoff", &tests::gammaWatchBackoff },
+    { "ramp_cache", &tests::rampCache },
+    { "status_stress", &tests::statusStress },
+    { "temperature_validation", &tests::temperatureValidation },
+};
+
+int main(int argc, char* argv[]) {
+    const char* prefix = (argc > 1) ? argv[1] : "";
+
+    wchar_t temp[MAX_PATH];
+    GetTempPath(MAX_PATH, temp);
+    std::wstring appData = std::wstring(temp) + L"dimmer-tests";
+    SetEnvironmentVariable(L"APPDATA", appData.c_str());
+
+    int failed = 0;
+    for (auto& suite : suites) {
+        if (strncmp(suite.name, prefix, strlen(prefix)) != 0) {
+            continue;
+        }
+        printf("%s\n", suite.name);
+        const int before = tests::failures;
+        if (!suite.run() || tests::failures != before) {
+            printf("%s FAILED\n", suite.name);
+            ++failed;
+        }
+    }
+
+    dimmer::flushConfig();
+    return failed ? 1 : 0;
+}
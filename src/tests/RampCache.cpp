@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <Windows.h>
+#include "../GammaRamp.h"
+#include "Tests.h"
+#include <cstring>
+#include <memory>
+
+/* the ramp cache holds what the current settings need, not every ramp it
+was ever asked for: dragging the temperature through its whole range (or a
+script stepping through it) must not leave thousands of 1.5KB ramps
+behind. */
+
+using namespace dimmer;
+
+using Settings = std::vector<std::pair<ToneCurvePtr, int>>;
+
+bool tests::rampCache() {
+    prepareGammaRamps(Settings { { ToneCurvePtr(), 4500 }, { ToneCurvePtr(), 5000 } }, { 100 });
+    EXPECT(getCachedRampCount() == 2);
+
+    GammaRamp warm = getGammaRamp(ToneCurvePtr(), 4500, 100);
+    EXPECT(isCachedRamp(warm));
+    EXPECT(getCachedRampCount() == 2);
+
+    EXPECT(isIdentityRamp(getGammaRamp(ToneCurvePtr(), -1, 100)));
+
+    /* every temperature and a few brightness levels, none of them prepared */
+    for (int temperature = 1000; temperature <= 10000; temperature++) {
+        getGammaRamp(ToneCurvePtr(), temperature, 50 + temperature % 11 * 5);
+        EXPECT(getCachedRampCount() <= 2 + maxUnpreparedRamps);
+    }
+
+    /* prepared ramps survive the on-demand churn */
+    EXPECT(isCachedRamp(warm));
+
+    /* new settings replace the old ones */
+    auto curve = std::make_shared<ToneCurve>();
+    curve->gamma = 1.8f;
+    ToneCurvePtr shared = curve;
+    prepareGammaRamps(Settings { { shared, 6000 } }, { 100, 75, 50 });
+    EXPECT(getCachedRampCount() == 3);
+    EXPECT(!isCachedRamp(warm));
+    EXPECT(isCachedRamp(GammaRamp(getGammaRamp(shared, 6000, 75))));
+    EXPECT(getCachedRampCount() == 3);
+
+    /* and let go of curves nobody uses anymore */
+    const long references = shared.use_count();
+    prepareGammaRamps(Settings(), { 100 });
+    EXPECT(getCachedRampCount() == 0);
+    EXPECT(shared.use_count() == references - 3);
+
+    return true;
+}
@@ -0,0 +1,160 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "../Status.h"
+#include "Tests.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* hammers the status seqlock with one writer and several readers. every
+write stamps the same generation into every field of the segment, so any
+snapshot that mixes two writes (a torn read) shows up as a field that
+disagrees with the others. fails if one is seen. */
+
+using namespace dimmer::status;
+
+static const auto duration = std::chrono::seconds(2);
+
+static void stamp(Segment& segment, uint32_t generation) {
+    segment.dimmerEnabled = generation;
+    segment.pollingEnabled = generation;
+    segment.monitorCount = 1 + generation % maxMonitors;
+
+    std::string id = std::to_string(generation);
+    for (uint32_t i = 0; i < maxMonitors; i++) {
+        MonitorStatus& m = segment.monitors[i];
+        memset(m.id, 0, sizeof(m.id));
+        memcpy(m.id, id.c_str(), id.size());
+        memset(m.name, (int) (generation & 0x7f), sizeof(m.name));
+        m.opacity = (float) generation;
+        m.temperature = (int32_t) generation;
+        m.enabled = generation;
+        m.gammaRejected = generation;
+        m.effectiveOpacity = (float) generation;
+        m.effectiveTemperature = (int32_t) generation;
+    }
+}
+
+static bool consistent(const Segment& segment) {
+    uint32_t generation = segment.dimmerEnabled;
+    if (segment.pollingEnabled != generation ||
+        segment.monitorCount != 1 + generation % maxMonitors)
+    {
+        return false;
+    }
+
+    std::string id = std::to_string(generation);
+    for (uint32_t i = 0; i < maxMonitors; i++) {
+        const MonitorStatus& m = segment.monitors[i];
+        if (id != m.id ||
+            m.name[0] != (char) (generation & 0x7f) ||
+            m.name[sizeof(m.name) - 1] != (char) (generation & 0x7f) ||
+            m.opacity != (float) generation ||
+            m.temperature != (int32_t) generation ||
+            m.enabled != generation ||
+            m.gammaRejected != generation ||
+            m.effectiveOpacity != (float) generation ||
+            m.effectiveTemperature != (int32_t) generation)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool tests::statusStress() {
+    std::unique_ptr<Segment> segment(new Segment());
+    segment->sequence = 0;
+    stamp(*segment, 0);
+
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> snapshots(0), torn(0), backwards(0);
+
+    /* hardware_concurrency() may be 0 (unknown) */
+    const unsigned hc = std::thread::hardware_concurrency();
+    unsigned readerCount = std::max(2u, hc > 1 ? hc - 1 : 1u);
+    std::vector<std::thread> readers;
+
+    for (unsigned i = 0; i < readerCount; i++) {
+        readers.push_back(std::thread([&] {
+            std::unique_ptr<Segment> snapshot(new Segment());
+            uint32_t last = 0;
+            while (!done) {
+                read(segment.get(), *snapshot);
+                ++snapshots;
+                if (!consistent(*snapshot)) {
+                    ++torn;
+                }
+                else if (snapshot->dimmerEnabled < last) {
+                    ++backwards;
+                }
+                last = snapshot->dimmerEnabled;
+            }
+        }));
+    }
+
+    /* vary the gap between writes so readers land both inside and between
+    them. */
+    uint32_t generation = 0;
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+        ++generation;
+        write(segment.get(), [generation](Segment& s) {
+            stamp(s, generation);
+        });
+        for (volatile uint32_t spin = 0; spin < (generation % 64) * 256; spin++) {
+        }
+    }
+
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    printf(
+        "  %u writes, %u readers, %llu snapshots, %llu torn, %llu out of order\n",
+        generation,
+        readerCount,
+        (unsigned long long) snapshots,
+        (unsigned long long) torn,
+        (unsigned long long) backwards);
+
+    return torn == 0 && backwards == 0;
+}
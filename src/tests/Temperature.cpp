@@ -0,0 +1,98 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <Windows.h>
+#include "../Control.h"
+#include "../Monitor.h"
+#include "../Util.h"
+#include "Tests.h"
+#include <string>
+
+/* temperatures outside [minTemperature, maxTemperature] other than -1 are
+rejected by the control pipe and dropped (to "no temperature") when they
+come from config.json, rather than being clamped to the nearest bound. */
+
+using namespace dimmer;
+
+static std::string set(const std::string& value, bool& changed) {
+    changed = false;
+    return executeCommands("set * temperature " + value, changed);
+}
+
+bool tests::temperatureValidation() {
+    EXPECT(isValidTemperature(-1));
+    EXPECT(isValidTemperature(minTemperature));
+    EXPECT(isValidTemperature(6500));
+    EXPECT(isValidTemperature(maxTemperature));
+    EXPECT(!isValidTemperature(0));
+    EXPECT(!isValidTemperature(-2));
+    EXPECT(!isValidTemperature(minTemperature - 1));
+    EXPECT(!isValidTemperature(maxTemperature + 1));
+
+    /* rejected before any monitor is looked at, so this holds with no
+    displays attached too. */
+    bool changed = false;
+    for (auto value : { "0", "-2", "-1000", "999", "10001", "4294967296", "5000k", "" }) {
+        std::string reply = set(value, changed);
+        EXPECT(reply == (*value ? "error invalid value\n" : "error missing value\n"));
+        EXPECT(!changed);
+    }
+    for (auto value : { "-1", "1000", "4500", "10000" }) {
+        EXPECT(set(value, changed) == "ok\n");
+    }
+    set("-1", changed);
+    flushConfig();
+
+    /* a hand-edited config.json */
+    Monitor monitor(reinterpret_cast<HMONITOR>((uintptr_t) 1), 0);
+    Monitor other(reinterpret_cast<HMONITOR>((uintptr_t) 2), 1);
+    std::string config =
+        "{\"monitors\":{"
+        "\"" + u16to8(monitor.getId()) + "\":{\"temperature\":0},"
+        "\"" + u16to8(other.getId()) + "\":{\"temperature\":4500}},"
+        "\"apps\":{"
+        "\"hot.exe\":{\"temperature\":20000},"
+        "\"warm.exe\":{\"temperature\":3000}}}";
+    EXPECT(stringToFile(getDataDirectory() + L"\\config.json", config));
+    loadConfig();
+
+    EXPECT(getMonitorTemperature(monitor) == -1);
+    EXPECT(getMonitorTemperature(other) == 4500);
+    auto hot = findAppProfile(L"hot.exe");
+    auto warm = findAppProfile(L"warm.exe");
+    EXPECT(hot && hot->temperature == 0);
+    EXPECT(warm && warm->temperature == 3000);
+
+    return true;
+}